@@ -0,0 +1,511 @@
+// Load generator for the HTTP endpoints.  An App is started in-process
+// against a local dataset, normally the one created by
+// scripts/generate-test-data.sh, and driven with a fixed mix of requests at
+// a fixed concurrency.  The request sequence is generated up front from a
+// seed, so runs with the same options issue exactly the same requests.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <simple-web-server/client_http.hpp>
+#include <json/json.h>
+
+#include <entwine/util/json.hpp>
+
+#include <greyhound/app.hpp>
+#include <greyhound/configuration.hpp>
+
+namespace greyhound
+{
+namespace
+{
+
+using Client = SimpleWeb::Client<SimpleWeb::HTTP>;
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+    std::string data = "./data";
+    std::string config;
+    std::string resource = "ellipsoid";
+    std::string mix = "info:1,hierarchy:2,read:6,count:1";
+    std::string out;
+    unsigned int port = 8089;
+    std::size_t concurrency = 8;
+    std::size_t requests = 2000;
+    std::size_t warmup = 200;
+    std::size_t seed = 1;
+    bool compress = false;
+};
+
+void usage()
+{
+    std::cout <<
+        "Usage: greyhound-bench [options]\n"
+        "\t--data <dir>         Resource directory (./data)\n"
+        "\t--config <path>      Greyhound configuration file\n"
+        "\t--resource <name>    Resource to query (ellipsoid)\n"
+        "\t--mix <mix>          Weighted endpoint mix\n"
+        "\t                     (info:1,hierarchy:2,read:6,count:1)\n"
+        "\t--concurrency <n>    Concurrent clients (8)\n"
+        "\t--requests <n>       Measured requests (2000)\n"
+        "\t--warmup <n>         Unmeasured requests run first (200)\n"
+        "\t--seed <n>           Request sequence seed (1)\n"
+        "\t--port <n>           Port for the in-process server (8089)\n"
+        "\t--compress           Request compressed reads\n"
+        "\t--out <path>         Also write results as JSON\n" <<
+        std::endl;
+}
+
+Options parseOptions(const int argc, char** argv)
+{
+    Options o;
+    for (int i(1); i < argc; ++i)
+    {
+        const std::string a(argv[i]);
+        auto next([&]() -> std::string
+        {
+            if (i + 1 >= argc) throw std::runtime_error("Missing value: " + a);
+            return std::string(argv[++i]);
+        });
+
+        if (a == "--data") o.data = next();
+        else if (a == "--config") o.config = next();
+        else if (a == "--resource") o.resource = next();
+        else if (a == "--mix") o.mix = next();
+        else if (a == "--out") o.out = next();
+        else if (a == "--port") o.port = std::stoul(next());
+        else if (a == "--concurrency") o.concurrency = std::stoul(next());
+        else if (a == "--requests") o.requests = std::stoul(next());
+        else if (a == "--warmup") o.warmup = std::stoul(next());
+        else if (a == "--seed") o.seed = std::stoul(next());
+        else if (a == "--compress") o.compress = true;
+        else if (a == "-h" || a == "--help") { usage(); std::exit(0); }
+        else throw std::runtime_error("Unknown option: " + a);
+    }
+
+    if (!o.concurrency) throw std::runtime_error("Invalid concurrency");
+    return o;
+}
+
+// Endpoint weights, as "name:weight" pairs separated by commas.
+std::map<std::string, double> parseMix(const std::string& s)
+{
+    std::map<std::string, double> mix;
+    std::istringstream ss(s);
+    std::string item;
+
+    while (std::getline(ss, item, ','))
+    {
+        const auto colon(item.find(':'));
+        const std::string name(item.substr(0, colon));
+        const double weight(
+                colon == std::string::npos ?
+                    1.0 : std::stod(item.substr(colon + 1)));
+
+        if (
+                name != "info" && name != "hierarchy" &&
+                name != "read" && name != "count")
+        {
+            throw std::runtime_error("Unknown endpoint in mix: " + name);
+        }
+
+        if (weight > 0) mix[name] = weight;
+    }
+
+    if (mix.empty()) throw std::runtime_error("Empty mix");
+    return mix;
+}
+
+struct Request
+{
+    std::string endpoint;
+    std::string path;
+};
+
+std::string toString(const std::vector<double>& bounds)
+{
+    std::ostringstream ss;
+    ss << std::setprecision(17) << "[";
+    for (std::size_t i(0); i < bounds.size(); ++i)
+    {
+        ss << (i ? "," : "") << bounds[i];
+    }
+    ss << "]";
+    return ss.str();
+}
+
+// Generate the request sequence.  Spatial queries select a random node a
+// few levels beneath the root bounds, like a client exploring the dataset.
+std::vector<Request> plan(
+        const Options& o,
+        const Json::Value& info,
+        const std::size_t n)
+{
+    const auto mix(parseMix(o.mix));
+
+    std::vector<std::string> names;
+    std::vector<double> weights;
+    for (const auto& p : mix)
+    {
+        names.push_back(p.first);
+        weights.push_back(p.second);
+    }
+
+    std::vector<double> root;
+    for (const auto& v : info["bounds"]) root.push_back(v.asDouble());
+    if (root.size() != 6) throw std::runtime_error("Invalid info bounds");
+
+    std::mt19937_64 gen(o.seed);
+    std::discrete_distribution<std::size_t> pick(
+            weights.begin(),
+            weights.end());
+    std::uniform_int_distribution<int> levels(0, 4);
+    std::uniform_int_distribution<int> octant(0, 7);
+
+    // Nodes above this depth are few and large, so they are always fetched.
+    const int baseDepth(6);
+
+    const std::string prefix("/resource/" + o.resource + "/");
+    std::vector<Request> requests;
+
+    for (std::size_t i(0); i < n; ++i)
+    {
+        const std::string& endpoint(names[pick(gen)]);
+        std::string path(prefix + endpoint);
+
+        if (endpoint != "info")
+        {
+            std::vector<double> b(root);
+            const int level(levels(gen));
+
+            for (int l(0); l < level; ++l)
+            {
+                const int dir(octant(gen));
+                for (int d(0); d < 3; ++d)
+                {
+                    const double mid(b[d] + (b[d + 3] - b[d]) / 2.0);
+                    if (dir & (1 << d)) b[d] = mid;
+                    else b[d + 3] = mid;
+                }
+            }
+
+            const int depth(baseDepth + level);
+            const int span(endpoint == "hierarchy" ? 4 : 1);
+
+            path += "?bounds=" + toString(b) +
+                "&depthBegin=" + std::to_string(depth) +
+                "&depthEnd=" + std::to_string(depth + span);
+
+            if (endpoint == "read" && o.compress) path += "&compress=true";
+        }
+
+        requests.push_back(Request { endpoint, path });
+    }
+
+    return requests;
+}
+
+struct Sample
+{
+    double ms = 0;
+    std::size_t bytes = 0;
+    bool ok = false;
+};
+
+struct Stats
+{
+    std::vector<double> ms;
+    std::size_t bytes = 0;
+    std::size_t errors = 0;
+};
+
+std::size_t statusOf(const Client::Response& res)
+{
+    return std::stoul(res.status_code.substr(0, 3));
+}
+
+// Run the requests on `concurrency` clients, each with its own keep-alive
+// connection, returning one sample per request.
+std::vector<Sample> run(
+        const Options& o,
+        const std::vector<Request>& requests,
+        double& seconds)
+{
+    std::vector<Sample> samples(requests.size());
+    std::atomic<std::size_t> index(0);
+    const std::string host("localhost:" + std::to_string(o.port));
+
+    const auto start(Clock::now());
+
+    std::vector<std::thread> threads;
+    for (std::size_t t(0); t < o.concurrency; ++t)
+    {
+        threads.emplace_back([&]()
+        {
+            std::unique_ptr<Client> client(new Client(host));
+
+            std::size_t i(0);
+            while ((i = index++) < requests.size())
+            {
+                Sample& sample(samples[i]);
+                const auto begin(Clock::now());
+
+                try
+                {
+                    auto res(client->request("GET", requests[i].path));
+                    sample.bytes = res->content.size();
+                    sample.ok = statusOf(*res) / 100 == 2;
+                }
+                catch (std::exception&)
+                {
+                    // Start over with a fresh connection.
+                    client.reset(new Client(host));
+                }
+
+                sample.ms = std::chrono::duration<double, std::milli>(
+                        Clock::now() - begin).count();
+            }
+        });
+    }
+
+    for (auto& t : threads) t.join();
+
+    seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return samples;
+}
+
+double percentile(const std::vector<double>& sorted, const double p)
+{
+    if (sorted.empty()) return 0;
+    const std::size_t i(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+// Current and peak resident set sizes of this process, which includes the
+// in-process server, from /proc/self/status.
+std::pair<std::size_t, std::size_t> rss()
+{
+    std::ifstream status("/proc/self/status");
+    std::size_t current(0), peak(0);
+    std::string line;
+
+    while (std::getline(status, line))
+    {
+        std::istringstream ss(line);
+        std::string key;
+        std::size_t kb(0);
+        ss >> key >> kb;
+
+        if (key == "VmRSS:") current = kb * 1024;
+        else if (key == "VmHWM:") peak = kb * 1024;
+    }
+
+    return std::make_pair(current, peak);
+}
+
+Json::Value report(
+        const std::vector<Request>& requests,
+        const std::vector<Sample>& samples,
+        const double seconds)
+{
+    std::map<std::string, Stats> stats;
+    Stats total;
+
+    for (std::size_t i(0); i < samples.size(); ++i)
+    {
+        const Sample& s(samples[i]);
+        for (Stats* st : { &stats[requests[i].endpoint], &total })
+        {
+            st->ms.push_back(s.ms);
+            st->bytes += s.bytes;
+            if (!s.ok) ++st->errors;
+        }
+    }
+
+    Json::Value json;
+    json["seconds"] = seconds;
+
+    auto describe([seconds](Stats& s) -> Json::Value
+    {
+        std::sort(s.ms.begin(), s.ms.end());
+
+        Json::Value j;
+        j["requests"] = static_cast<Json::UInt64>(s.ms.size());
+        j["errors"] = static_cast<Json::UInt64>(s.errors);
+        j["requestsPerSecond"] = s.ms.size() / seconds;
+        j["bytesPerSecond"] = s.bytes / seconds;
+        j["p50"] = percentile(s.ms, 50);
+        j["p90"] = percentile(s.ms, 90);
+        j["p99"] = percentile(s.ms, 99);
+        j["max"] = s.ms.empty() ? 0.0 : s.ms.back();
+        return j;
+    });
+
+    for (auto& p : stats) json["endpoints"][p.first] = describe(p.second);
+    json["total"] = describe(total);
+
+    const auto mem(rss());
+    json["rss"] = static_cast<Json::UInt64>(mem.first);
+    json["peakRss"] = static_cast<Json::UInt64>(mem.second);
+
+    return json;
+}
+
+void print(const Json::Value& json)
+{
+    auto row([](const std::string& name, const Json::Value& j)
+    {
+        std::cout << std::left << std::setw(12) << name << std::right <<
+            std::setw(9) << j["requests"].asUInt64() <<
+            std::setw(8) << j["errors"].asUInt64() <<
+            std::fixed << std::setprecision(1) <<
+            std::setw(10) << j["requestsPerSecond"].asDouble() <<
+            std::setw(10) << j["bytesPerSecond"].asDouble() / 1048576.0 <<
+            std::setprecision(2) <<
+            std::setw(10) << j["p50"].asDouble() <<
+            std::setw(10) << j["p90"].asDouble() <<
+            std::setw(10) << j["p99"].asDouble() <<
+            std::setw(10) << j["max"].asDouble() << std::endl;
+    });
+
+    std::cout << std::left << std::setw(12) << "Endpoint" << std::right <<
+        std::setw(9) << "Requests" << std::setw(8) << "Errors" <<
+        std::setw(10) << "Req/s" << std::setw(10) << "MB/s" <<
+        std::setw(10) << "p50 ms" << std::setw(10) << "p90 ms" <<
+        std::setw(10) << "p99 ms" << std::setw(10) << "Max ms" << std::endl;
+
+    for (const auto& name : json["endpoints"].getMemberNames())
+    {
+        row(name, json["endpoints"][name]);
+    }
+    row("total", json["total"]);
+
+    std::cout << "\nElapsed: " << std::setprecision(2) <<
+        json["seconds"].asDouble() << "s" << std::endl;
+    std::cout << "RSS: " << json["rss"].asUInt64() / 1048576 << " MB, " <<
+        "peak " << json["peakRss"].asUInt64() / 1048576 << " MB" << std::endl;
+}
+
+// Poll until the server answers for the resource, returning its info.
+Json::Value awaitInfo(const Options& o)
+{
+    const std::string path("/resource/" + o.resource + "/info");
+    const auto deadline(Clock::now() + std::chrono::seconds(60));
+
+    while (Clock::now() < deadline)
+    {
+        std::shared_ptr<Client::Response> res;
+
+        try
+        {
+            Client client("localhost:" + std::to_string(o.port));
+            res = client.request("GET", path);
+        }
+        catch (std::exception&)
+        {
+            // Not listening yet.
+        }
+
+        if (res)
+        {
+            const std::size_t status(statusOf(*res));
+            if (status == 200) return entwine::parse(res->content.string());
+            if (status == 404)
+            {
+                throw std::runtime_error("Resource not found: " + o.resource);
+            }
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    throw std::runtime_error("Timed out waiting for the server");
+}
+
+} // unnamed namespace
+} // namespace greyhound
+
+int main(int argc, char** argv)
+{
+    using namespace greyhound;
+
+    try
+    {
+        const Options o(parseOptions(argc, argv));
+
+        std::vector<std::string> args {
+            "greyhound", "-d", o.data, "-p", std::to_string(o.port)
+        };
+        if (o.config.size())
+        {
+            args.push_back("-c");
+            args.push_back(o.config);
+        }
+
+        std::vector<char*> argp;
+        for (auto& a : args) argp.push_back(&a[0]);
+
+        const Configuration config(static_cast<int>(argp.size()), argp.data());
+        App app(config);
+        std::thread server([&app]() { app.start(); });
+
+        try
+        {
+            const Json::Value info(awaitInfo(o));
+            const auto requests(plan(o, info, o.warmup + o.requests));
+
+            const std::vector<Request> warmup(
+                    requests.begin(),
+                    requests.begin() + o.warmup);
+            const std::vector<Request> measured(
+                    requests.begin() + o.warmup,
+                    requests.end());
+
+            double seconds(0);
+            if (warmup.size()) run(o, warmup, seconds);
+
+            const auto samples(run(o, measured, seconds));
+            const Json::Value results(report(measured, samples, seconds));
+
+            std::cout << std::endl;
+            print(results);
+
+            if (o.out.size())
+            {
+                std::ofstream out(o.out);
+                out << results.toStyledString();
+            }
+        }
+        catch (...)
+        {
+            app.stop();
+            server.join();
+            throw;
+        }
+
+        app.stop();
+        server.join();
+    }
+    catch (std::exception& e)
+    {
+        std::cout << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
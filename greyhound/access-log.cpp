@@ -0,0 +1,426 @@
+#include <greyhound/access-log.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+namespace greyhound
+{
+
+namespace
+{
+
+std::string dense(const Json::Value& json)
+{
+    auto s = Json::FastWriter().write(json);
+    s.pop_back();
+    return s;
+}
+
+enum class Color
+{
+    Black,
+    Red,
+    Green,
+    Yellow,
+    Blue,
+    Magenta,
+    Cyan,
+    White
+};
+
+const std::map<Color, std::string> colorCodes {
+    { Color::Black,     "\x1b[30m" },
+    { Color::Red,       "\x1b[31m" },
+    { Color::Green,     "\x1b[32m" },
+    { Color::Yellow,    "\x1b[33m" },
+    { Color::Blue,      "\x1b[34m" },
+    { Color::Magenta,   "\x1b[35m" },
+    { Color::Cyan,      "\x1b[36m" },
+    { Color::White,     "\x1b[37m" }
+};
+
+std::string color(const std::string& s, Color c)
+{
+    return colorCodes.at(c) + s + "\x1b[0m";
+}
+
+// Console labels and colors, by endpoint.
+const std::map<std::string, std::pair<std::string, Color>> labels {
+    { "info",       { "info",   Color::Green } },
+    { "hierarchy",  { "hier",   Color::Yellow } },
+    { "files",      { "file",   Color::Green } },
+    { "read",       { "read",   Color::Cyan } },
+    { "count",      { "count",  Color::Cyan } },
+    { "write",      { "write",  Color::Yellow } }
+};
+
+std::string depth(int64_t d)
+{
+    return d >= 0 ? std::to_string(d) : "all";
+}
+
+std::string quote(const std::string& s)
+{
+    if (!s.empty() && s.find_first_of(" =\"\\") == std::string::npos)
+    {
+        return s;
+    }
+
+    std::string out("\"");
+    for (const char c : s)
+    {
+        if (c == '"' || c == '\\') out.push_back('\\');
+        out.push_back(c);
+    }
+    return out + "\"";
+}
+
+AccessLog::Format parseFormat(const std::string& s)
+{
+    if (s.empty() || s == "console") return AccessLog::Format::Console;
+    if (s == "json") return AccessLog::Format::Json;
+    if (s == "logfmt") return AccessLog::Format::Logfmt;
+    if (s == "otlp") return AccessLog::Format::Otlp;
+    throw std::runtime_error("Invalid access log format: " + s);
+}
+
+std::atomic<uint64_t> nextId(1);
+
+Json::Value attribute(const std::string& key, const Json::Value& value)
+{
+    Json::Value a;
+    a["key"] = key;
+    if (value.isString()) a["value"]["stringValue"] = value;
+    else if (value.isBool()) a["value"]["boolValue"] = value;
+    // OTLP JSON encodes 64-bit integers as strings.
+    else a["value"]["intValue"] = value.asString();
+    return a;
+}
+
+std::string nanos(int64_t micros)
+{
+    return std::to_string(micros) + "000";
+}
+
+} // unnamed namespace
+
+AccessLog::Entry::Entry(
+        const std::string& resource,
+        const std::string& endpoint,
+        const Json::Value& q)
+    : resource(resource)
+    , endpoint(endpoint)
+    , time(std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count())
+{
+    if (q.isMember("depthBegin")) depthBegin = q["depthBegin"].asUInt();
+    else if (q.isMember("depth")) depthBegin = q["depth"].asUInt();
+
+    if (q.isMember("depthEnd")) depthEnd = q["depthEnd"].asUInt();
+    else if (q.isMember("depth")) depthEnd = q["depth"].asUInt() + 1;
+
+    if (q.isMember("filter")) filter = dense(q["filter"]);
+}
+
+AccessLog::AccessLog(const Configuration& config)
+    : m_id(nextId++)
+{
+    if (!config.json().isMember("accessLog"))
+    {
+        m_sinks.emplace_back(new Sink(Format::Console, ""));
+    }
+    else
+    {
+        Json::Value sinks(config["accessLog"]);
+        if (sinks.isObject())
+        {
+            Json::Value single(sinks);
+            sinks = Json::arrayValue;
+            sinks.append(single);
+        }
+
+        for (const auto& sink : sinks)
+        {
+            m_sinks.emplace_back(
+                    new Sink(
+                        parseFormat(sink["format"].asString()),
+                        sink["path"].asString()));
+
+            if (m_sinks.back()->format() == Format::Otlp) m_traced = true;
+        }
+    }
+
+    m_thread = std::thread([this]() { run(); });
+}
+
+AccessLog::~AccessLog()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_done = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+}
+
+void AccessLog::push(Entry entry)
+{
+    if (m_sinks.empty()) return;
+    if (!ring().push(entry)) ++m_dropped;
+}
+
+AccessLog::Ring& AccessLog::ring()
+{
+    thread_local uint64_t owner(0);
+    thread_local std::shared_ptr<Ring> local;
+
+    if (owner != m_id)
+    {
+        local = std::make_shared<Ring>();
+        owner = m_id;
+
+        std::lock_guard<std::mutex> lock(m_ringsMutex);
+        m_rings.push_back(local);
+    }
+
+    return *local;
+}
+
+void AccessLog::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_done)
+    {
+        m_cv.wait_for(lock, std::chrono::milliseconds(100), [this]()
+        {
+            return m_done;
+        });
+
+        lock.unlock();
+        drain();
+        lock.lock();
+    }
+
+    lock.unlock();
+    drain();
+}
+
+void AccessLog::drain()
+{
+    std::vector<std::shared_ptr<Ring>> rings;
+    {
+        std::lock_guard<std::mutex> lock(m_ringsMutex);
+        rings = m_rings;
+    }
+
+    Entry entry;
+    bool any(false);
+
+    for (auto& r : rings)
+    {
+        while (r->pop(entry))
+        {
+            any = true;
+            for (auto& sink : m_sinks) sink->write(entry);
+        }
+    }
+
+    if (any) for (auto& sink : m_sinks) sink->flush();
+
+    rings.clear();
+
+    // Reclaim the rings of exited threads.
+    std::lock_guard<std::mutex> lock(m_ringsMutex);
+    for (auto it(m_rings.begin()); it != m_rings.end(); )
+    {
+        if (it->use_count() == 1 && (*it)->empty()) it = m_rings.erase(it);
+        else ++it;
+    }
+}
+
+bool AccessLog::Ring::push(Entry& entry)
+{
+    const std::size_t tail(m_tail.load(std::memory_order_relaxed));
+    const std::size_t next((tail + 1) % capacity);
+    if (next == m_head.load(std::memory_order_acquire)) return false;
+
+    m_entries[tail] = std::move(entry);
+    m_tail.store(next, std::memory_order_release);
+    return true;
+}
+
+bool AccessLog::Ring::pop(Entry& entry)
+{
+    const std::size_t head(m_head.load(std::memory_order_relaxed));
+    if (head == m_tail.load(std::memory_order_acquire)) return false;
+
+    entry = std::move(m_entries[head]);
+    m_head.store((head + 1) % capacity, std::memory_order_release);
+    return true;
+}
+
+AccessLog::Sink::Sink(const Format format, const std::string path)
+    : m_format(format)
+    , m_os(&std::cout)
+{
+    if (path.size())
+    {
+        m_file.reset(new std::ofstream(path, std::ios::out | std::ios::app));
+        if (!m_file->good())
+        {
+            throw std::runtime_error("Could not open access log: " + path);
+        }
+        m_os = m_file.get();
+    }
+}
+
+void AccessLog::Sink::writeOtlp(const Entry& e)
+{
+    if (!e.trace) return;
+    const Trace& trace(*e.trace);
+
+    const auto children(trace.spans());
+
+    // The entry's duration excludes time spent queued, which the trace
+    // includes, so the root span covers whichever ends later.
+    const int64_t start(trace.epochMicros());
+    int64_t end(start + e.ms * 1000);
+    for (const Trace::Span& s : children)
+    {
+        end = std::max(end, start + s.start + s.duration);
+    }
+
+    Json::Value spans(Json::arrayValue);
+
+    Json::Value root;
+    root["traceId"] = trace.traceId();
+    root["spanId"] = Trace::spanId();
+    if (trace.parentId().size()) root["parentSpanId"] = trace.parentId();
+    root["name"] = e.endpoint;
+    root["kind"] = 2;   // SPAN_KIND_SERVER
+    root["startTimeUnixNano"] = nanos(start);
+    root["endTimeUnixNano"] = nanos(end);
+
+    Json::Value& attributes(root["attributes"]);
+    attributes.append(attribute("greyhound.resource", e.resource));
+    attributes.append(attribute("greyhound.points", Json::UInt64(e.points)));
+    attributes.append(attribute("greyhound.bytes", Json::UInt64(e.bytes)));
+    attributes.append(attribute("greyhound.cached", e.cached));
+    attributes.append(attribute("greyhound.canceled", e.canceled));
+    if (e.depthBegin >= 0)
+    {
+        attributes.append(
+                attribute("greyhound.depthBegin", Json::Int64(e.depthBegin)));
+    }
+    if (e.depthEnd >= 0)
+    {
+        attributes.append(
+                attribute("greyhound.depthEnd", Json::Int64(e.depthEnd)));
+    }
+    spans.append(root);
+
+    for (const Trace::Span& s : children)
+    {
+        Json::Value span;
+        span["traceId"] = trace.traceId();
+        span["spanId"] = Trace::spanId();
+        span["parentSpanId"] = root["spanId"];
+        span["name"] = s.name;
+        span["kind"] = 1;   // SPAN_KIND_INTERNAL
+        span["startTimeUnixNano"] = nanos(start + s.start);
+        span["endTimeUnixNano"] = nanos(start + s.start + s.duration);
+        spans.append(span);
+    }
+
+    Json::Value json;
+    Json::Value& resourceSpans(json["resourceSpans"][0]);
+    resourceSpans["resource"]["attributes"].append(
+            attribute("service.name", "greyhound"));
+
+    Json::Value& scopeSpans(resourceSpans["scopeSpans"][0]);
+    scopeSpans["scope"]["name"] = "greyhound";
+    scopeSpans["spans"] = spans;
+
+    *m_os << dense(json) << '\n';
+}
+
+void AccessLog::Sink::write(const Entry& e)
+{
+    std::ostream& os(*m_os);
+
+    if (m_format == Format::Otlp)
+    {
+        writeOtlp(e);
+    }
+    else if (m_format == Format::Json)
+    {
+        Json::Value json;
+        json["time"] = Json::Int64(e.time);
+        json["resource"] = e.resource;
+        json["endpoint"] = e.endpoint;
+        json["depthBegin"] = e.depthBegin >= 0 ?
+            Json::Value(Json::Int64(e.depthBegin)) : Json::Value();
+        json["depthEnd"] = e.depthEnd >= 0 ?
+            Json::Value(Json::Int64(e.depthEnd)) : Json::Value();
+        json["points"] = Json::UInt64(e.points);
+        json["bytes"] = Json::UInt64(e.bytes);
+        json["ms"] = Json::UInt64(e.ms);
+        json["canceled"] = e.canceled;
+        json["cached"] = e.cached;
+        if (e.filter.size()) json["filter"] = e.filter;
+        if (e.query.size()) json["query"] = e.query;
+        os << dense(json) << '\n';
+    }
+    else if (m_format == Format::Logfmt)
+    {
+        os <<
+            "time=" << e.time <<
+            " resource=" << quote(e.resource) <<
+            " endpoint=" << e.endpoint <<
+            " depthBegin=" << depth(e.depthBegin) <<
+            " depthEnd=" << depth(e.depthEnd) <<
+            " points=" << e.points <<
+            " bytes=" << e.bytes <<
+            " ms=" << e.ms <<
+            " canceled=" << (e.canceled ? "true" : "false") <<
+            " cached=" << (e.cached ? "true" : "false");
+        if (e.filter.size()) os << " filter=" << quote(e.filter);
+        if (e.query.size()) os << " query=" << quote(e.query);
+        os << '\n';
+    }
+    else
+    {
+        const auto it(labels.find(e.endpoint));
+        const auto label(
+                it != labels.end() ?
+                    it->second :
+                    std::make_pair(e.endpoint, Color::White));
+
+        os << e.resource << "/" << color(label.first, label.second) << ": " <<
+            color(std::to_string(e.ms), Color::Magenta) << " ms";
+
+        if (e.endpoint == "files")
+        {
+            os << " Q: " << e.query;
+        }
+        else if (e.endpoint != "info")
+        {
+            os << " D: [" << depth(e.depthBegin) << ", " <<
+                depth(e.depthEnd) << ")";
+
+            if (e.endpoint != "hierarchy") os << " P: " << e.points;
+        }
+
+        if (e.filter.size()) os << " F: " << e.filter;
+        if (e.cached) os << " " << color("cached", Color::Blue);
+        if (e.canceled) os << " " << color("canceled", Color::Red);
+
+        os << '\n';
+    }
+}
+
+} // namespace greyhound
+
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <json/json.h>
+
+#include <greyhound/configuration.hpp>
+#include <greyhound/defs.hpp>
+#include <greyhound/trace.hpp>
+
+namespace greyhound
+{
+
+// Per-request access logging.  Request threads push entries into their own
+// single-producer ring buffer without taking any shared lock, and a
+// background thread drains all rings into the configured sinks.
+class AccessLog
+{
+public:
+    struct Entry
+    {
+        Entry() = default;
+        Entry(
+                const std::string& resource,
+                const std::string& endpoint,
+                const Json::Value& query);
+
+        std::string resource;
+        std::string endpoint;
+
+        // A value of -1 means that the depth was not bounded.
+        int64_t depthBegin = -1;
+        int64_t depthEnd = -1;
+
+        uint64_t points = 0;
+        uint64_t bytes = 0;
+        std::size_t ms = 0;
+        bool canceled = false;
+        bool cached = false;
+
+        std::string filter;
+        std::string query;
+
+        // Milliseconds since the epoch at which the entry was created.
+        int64_t time = 0;
+
+        // The request's timing breakdown, if it was traced.
+        std::shared_ptr<const Trace> trace;
+    };
+
+    // The OTLP format writes each traced request as an OpenTelemetry
+    // ExportTraceServiceRequest in JSON, one per line, as read by the
+    // OpenTelemetry Collector's otlpjsonfile receiver.
+    enum class Format { Console, Json, Logfmt, Otlp };
+
+    AccessLog(const Configuration& config);
+    ~AccessLog();
+
+    // Never blocks.  If this thread's ring is full, the entry is dropped.
+    void push(Entry entry);
+
+    uint64_t dropped() const { return m_dropped; }
+
+    // True if any sink exports traces.
+    bool traced() const { return m_traced; }
+
+private:
+    class Ring
+    {
+    public:
+        bool push(Entry& entry);
+        bool pop(Entry& entry);
+        bool empty() const { return m_head == m_tail; }
+
+    private:
+        static constexpr std::size_t capacity = 1024;
+
+        std::vector<Entry> m_entries = std::vector<Entry>(capacity);
+        std::atomic<std::size_t> m_head{0};
+        std::atomic<std::size_t> m_tail{0};
+    };
+
+    class Sink
+    {
+    public:
+        Sink(Format format, std::string path);
+
+        void write(const Entry& entry);
+        void flush() { m_os->flush(); }
+
+        Format format() const { return m_format; }
+
+    private:
+        void writeOtlp(const Entry& entry);
+
+        const Format m_format;
+        std::unique_ptr<std::ofstream> m_file;
+        std::ostream* m_os;
+    };
+
+    Ring& ring();
+    void run();
+    void drain();
+
+    std::vector<std::unique_ptr<Sink>> m_sinks;
+    bool m_traced = false;
+
+    // Rings are shared with the thread-local registrations of the threads
+    // that write to them, so a ring whose thread has exited is only owned
+    // here and may be reclaimed once drained.
+    std::vector<std::shared_ptr<Ring>> m_rings;
+    std::mutex m_ringsMutex;
+
+    // Identifies this log to the thread-local ring registrations.
+    const uint64_t m_id;
+    std::atomic<uint64_t> m_dropped{0};
+
+    bool m_done = false;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_thread;
+};
+
+} // namespace greyhound
+
@@ -0,0 +1,55 @@
+#include <greyhound/admission.hpp>
+
+#include <entwine/util/unique.hpp>
+
+namespace greyhound
+{
+
+Admission::Admission(const Configuration& config)
+    : m_maxQueue(config["admission"]["maxQueue"].asUInt64())
+    , m_maxConcurrentReads(
+            config["admission"]["maxConcurrentReads"].asUInt64())
+    , m_maxPoints(config["admission"]["maxPoints"].asUInt64())
+{ }
+
+Admission::Slot::Slot(Admission& admission, const std::string& name)
+    : m_admission(admission)
+    , m_name(name)
+{ }
+
+Admission::Slot::~Slot()
+{
+    std::lock_guard<std::mutex> lock(m_admission.m_mutex);
+    auto it(m_admission.m_reads.find(m_name));
+    if (!--it->second) m_admission.m_reads.erase(it);
+}
+
+std::unique_ptr<Admission::Slot> Admission::acquire(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::size_t& reads(m_reads[name]);
+    if (m_maxConcurrentReads && reads >= m_maxConcurrentReads)
+    {
+        throw HttpError(
+                HttpStatusCode::client_error_too_many_requests,
+                "Too many concurrent reads of " + name);
+    }
+
+    ++reads;
+    return entwine::makeUnique<Slot>(*this, name);
+}
+
+void Admission::checkPoints(const std::size_t points) const
+{
+    if (m_maxPoints && points > m_maxPoints)
+    {
+        throw HttpError(
+                HttpStatusCode::client_error_payload_too_large,
+                "Query selects " + std::to_string(points) + " points, " +
+                "over the limit of " + std::to_string(m_maxPoints));
+    }
+}
+
+} // namespace greyhound
+
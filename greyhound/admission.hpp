@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <greyhound/configuration.hpp>
+#include <greyhound/defs.hpp>
+
+namespace greyhound
+{
+
+// Admission control limits from the "admission" configuration object, so
+// that a few heavy requests cannot monopolize the server.  A limit of zero
+// means unlimited.  Rejections are reported by throwing an HttpError.
+class Admission
+{
+public:
+    Admission(const Configuration& config);
+
+    // Requests waiting for a worker beyond this count, per priority lane,
+    // are rejected with 429.
+    std::size_t maxQueue() const { return m_maxQueue; }
+
+    // Reads estimated to select more than this many points are rejected
+    // with 413.
+    std::size_t maxPoints() const { return m_maxPoints; }
+
+    // Holds one of a resource's concurrent read slots for its lifetime.
+    class Slot
+    {
+    public:
+        Slot(Admission& admission, const std::string& name);
+        ~Slot();
+
+        Slot(const Slot&) = delete;
+        Slot& operator=(const Slot&) = delete;
+
+    private:
+        Admission& m_admission;
+        const std::string m_name;
+    };
+
+    // Throws a 429 if the resource already has maxConcurrentReads reads in
+    // progress.
+    std::unique_ptr<Slot> acquire(const std::string& name);
+
+    // Throws a 413 if the estimate exceeds maxPoints.
+    void checkPoints(std::size_t points) const;
+
+private:
+    const std::size_t m_maxQueue;
+    const std::size_t m_maxConcurrentReads;
+    const std::size_t m_maxPoints;
+
+    std::map<std::string, std::size_t> m_reads;
+    std::mutex m_mutex;
+};
+
+} // namespace greyhound
+
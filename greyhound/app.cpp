@@ -3,6 +3,7 @@
 #include <fstream>
 
 #include <entwine/third/arbiter/arbiter.hpp>
+#include <entwine/util/unique.hpp>
 
 namespace greyhound
 {
@@ -27,6 +28,15 @@ const std::string publicRoot(([]()->std::string
     return "";
 })());
 
+template<typename S>
+std::string describe(const Router<S>& router)
+{
+    return " (" + std::to_string(router.acceptors()) + " acceptor" +
+        (router.acceptors() > 1 ? "s" : "") + ", " +
+        std::to_string(router.ioThreads()) + " I/O thread" +
+        (router.ioThreads() > 1 ? "s" : "") + " each)";
+}
+
 }
 
 namespace routes
@@ -38,10 +48,14 @@ const std::string info(resourceBase + "/info$");
 const std::string filesRoot(resourceBase + "/files$");
 const std::string files(resourceBase + "/files/(.*)$");
 const std::string read(resourceBase + "/read$");
+const std::string batch(resourceBase + "/batch$");
 const std::string count(resourceBase + "/count$");
 const std::string hierarchy(resourceBase + "/hierarchy$");
 const std::string write(resourceBase + "/write$");
 
+const std::string metrics("^/metrics$");
+const std::string ready("^/ready$");
+
 const std::string renderRoot(resourceBase + "/static$");
 const std::string render(resourceBase + "/static/(.*)$");
 
@@ -51,6 +65,18 @@ App::App(const Configuration& config)
     : m_config(config)
     , m_manager(config)
 {
+    std::cout << "Static serve:\n\t";
+    if (publicRoot.size())
+    {
+        m_static = entwine::makeUnique<StaticFiles>(
+                publicRoot,
+                m_manager.codings());
+
+        std::cout << publicRoot << " (" << m_static->size() << " files, " <<
+            m_static->bytes() << " bytes)" << std::endl;
+    }
+    else std::cout << "(not found)" << std::endl;
+
     auto http(m_config["http"]);
     if (http.isNull()) http["port"] = 8080;
 
@@ -99,13 +125,15 @@ void App::start()
     std::cout << "Listening:" << std::endl;
     if (m_http)
     {
-        std::cout << "\tHTTP: " << m_http->port() << std::endl;
+        std::cout << "\tHTTP: " << m_http->port() << describe(*m_http) <<
+            std::endl;
         m_httpThread = std::thread([this]() { m_http->start(); });
     }
 
     if (m_https)
     {
-        std::cout << "\tHTTPS: " << m_https->port() << std::endl;
+        std::cout << "\tHTTPS: " << m_https->port() << describe(*m_https) <<
+            std::endl;
         m_httpsThread = std::thread([this]() { m_https->start(); });
     }
 
@@ -124,6 +152,7 @@ void App::registerRoutes(Router<S>& r)
 {
     using Req = typename S::Request;
     using Res = typename S::Response;
+    using Lane = typename Router<S>::Lane;
 
     r.put(routes::write, [](Resource& resource, Req& req, Res& res)
     {
@@ -133,18 +162,23 @@ void App::registerRoutes(Router<S>& r)
     r.get(routes::info, [](Resource& resource, Req& req, Res& res)
     {
         resource.info(req, res);
-    });
+    }, Lane::Light);
 
     r.get(routes::hierarchy, [](Resource& resource, Req& req, Res& res)
     {
         resource.hierarchy(req, res);
-    });
+    }, Lane::Light);
 
     r.get(routes::read, [](Resource& resource, Req& req, Res& res)
     {
         resource.read(req, res);
     });
 
+    r.get(routes::batch, [](Resource& resource, Req& req, Res& res)
+    {
+        resource.batch(req, res);
+    });
+
     r.get(routes::count, [](Resource& resource, Req& req, Res& res)
     {
         resource.count(req, res);
@@ -153,37 +187,66 @@ void App::registerRoutes(Router<S>& r)
     r.get(routes::filesRoot, [](Resource& resource, Req& req, Res& res)
     {
         resource.files(req, res);
-    });
+    }, Lane::Light);
 
     r.get(routes::files, [](Resource& resource, Req& req, Res& res)
     {
         resource.files(req, res);
+    }, Lane::Light);
+
+    r.raw("GET", routes::metrics, Lane::Light, [this](Req& req, Res& res)
+    {
+        Headers h(m_manager.headers());
+        h.erase("Cache-Control");
+        h.emplace("Cache-Control", "no-cache");
+        h.emplace("Content-Type", "text/plain; version=0.0.4");
+        res.write(m_manager.metrics().text(), h);
     });
 
-    std::cout << "Static serve:\n\t";
-    if (publicRoot.size()) std::cout << publicRoot << std::endl;
-    else
+    r.raw("GET", routes::ready, Lane::Light, [this](Req& req, Res& res)
     {
-        std::cout << "(not found)" << std::endl;
-        return;
-    }
+        Headers h(m_manager.headers());
+        h.erase("Cache-Control");
+        h.emplace("Cache-Control", "no-cache");
+        h.emplace("Content-Type", "text/plain");
 
-    auto render([](Resource& resource, Req& req, Res& res)
+        if (m_manager.ready()) res.write("Ready", h);
+        else
+        {
+            res.write(
+                    HttpStatusCode::server_error_service_unavailable,
+                    "Prewarming",
+                    h);
+        }
+    });
+
+    if (!m_static) return;
+
+    auto render([this](Resource& resource, Req& req, Res& res)
     {
         std::string p(req.path_match[2]);
         if (p.empty()) p = "index.html";
 
-        const std::string path(entwine::arbiter::util::join(publicRoot, p));
-        auto ifs = std::make_shared<std::ifstream>(
-                path,
-                std::ifstream::in | std::ios::binary | std::ios::ate);
-
-        if (ifs->good()) res.write(*ifs);
-        else res.write(HttpStatusCode::client_error_not_found);
+        const auto query(req.parse_query_string());
+        const auto v(query.find("v"));
+
+        const auto accept(req.header.find("Accept-Encoding"));
+        const auto coding(
+                accept != req.header.end() ?
+                    m_manager.coding(accept->second) :
+                    encoding::Coding::Identity);
+
+        m_static->serve(
+                req,
+                res,
+                p,
+                v != query.end() ? v->second : "",
+                coding,
+                m_manager.headers());
     });
 
-    r.get(routes::render, render);
-    r.get(routes::renderRoot, render);
+    r.get(routes::render, render, Lane::Light);
+    r.get(routes::renderRoot, render, Lane::Light);
 }
 
 template void App::registerRoutes(Router<Http>&);
@@ -3,6 +3,7 @@
 #include <greyhound/configuration.hpp>
 #include <greyhound/manager.hpp>
 #include <greyhound/router.hpp>
+#include <greyhound/static-files.hpp>
 
 namespace greyhound
 {
@@ -20,6 +21,7 @@ private:
 
     Configuration m_config;
     Manager m_manager;
+    std::unique_ptr<StaticFiles> m_static;
 
     std::unique_ptr<Router<Http>> m_http;
     std::unique_ptr<Router<Https>> m_https;
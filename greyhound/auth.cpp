@@ -1,6 +1,8 @@
 #include <greyhound/auth.hpp>
 
+#include <algorithm>
 #include <cctype>
+#include <exception>
 
 #include <entwine/util/json.hpp>
 #include <entwine/util/unique.hpp>
@@ -56,6 +58,27 @@ Cookies parseCookies(Req& req)
     return cookies;
 }
 
+template<typename Req>
+std::string userId(Req& req, const Query& query, const Auth& auth)
+{
+    const auto cookies(parseCookies(req));
+
+    std::string id;
+    for (const auto& c : auth.cookies())
+    {
+        auto it(cookies.find(c));
+        if (it != cookies.end()) id += it->second;
+        id += "-";
+    }
+    for (const auto& q : auth.queries())
+    {
+        auto it(query.find(q));
+        if (it != query.end()) id += it->second;
+        id += "-";
+    }
+    return id;
+}
+
 } // unnamed namespace
 
 Auth::Auth(
@@ -63,54 +86,296 @@ Auth::Auth(
         const std::vector<std::string> cookies,
         const std::vector<std::string> queries,
         const std::size_t good,
-        const std::size_t bad)
+        const std::size_t bad,
+        const std::size_t stale,
+        const std::size_t maxEntries)
     : m_ep(ep)
     , m_cookies(cookies)
     , m_queries(queries)
     , m_good(std::max<std::size_t>(good, 60))
     , m_bad(std::max<std::size_t>(bad, 60))
+    , m_stale(stale)
+    , m_maxEntries(std::max<std::size_t>(maxEntries, numShards))
+    , m_refreshes(0)
+    , m_pool(4, maxRefreshes)
 { }
 
 template<typename Req>
 HttpStatusCode Auth::check(const std::string& resource, Req& req)
 {
-    const auto cookies(parseCookies(req));
+    return check(std::vector<std::string> { resource }, req).second;
+}
+
+template<typename Req>
+std::pair<std::string, HttpStatusCode> Auth::check(
+        const std::vector<std::string>& names,
+        Req& req)
+{
     const Query inQuery(req.parse_query_string());
+    const std::string id(userId(req, inQuery, *this));
 
-    std::string id;
-    for (const auto c : m_cookies)
+    std::vector<std::string> keys;
+    std::vector<HttpStatusCode> codes(names.size());
+    std::vector<std::size_t> missing;
+    std::vector<std::size_t> waiting;
+
+    std::unique_ptr<ArbiterHeaders> h;
+    std::unique_ptr<ArbiterQuery> q;
+    auto forward([&]()
     {
-        auto it(cookies.find(c));
-        const std::string val(it != cookies.end() ? it->second : "");
-        id += val + "-";
+        if (!h)
+        {
+            h = entwine::makeUnique<ArbiterHeaders>(
+                    req.header.begin(),
+                    req.header.end());
+            q = entwine::makeUnique<ArbiterQuery>(
+                    inQuery.begin(),
+                    inQuery.end());
+        }
+    });
+
+    auto handle([&](const std::size_t i, const State state)
+    {
+        const std::string& key(keys[i]);
+        const std::string& name(names[i]);
+
+        switch (state)
+        {
+            case State::Fresh:
+                break;
+
+            case State::Stale:
+            {
+                // Serve the stale result while it is refreshed in the
+                // background.
+                forward();
+                const ArbiterHeaders hc(*h);
+                const ArbiterQuery qc(*q);
+                m_pool.add([this, key, name, hc, qc]()
+                {
+                    try
+                    {
+                        store(key, fetch(name, hc, qc));
+                    }
+                    catch (std::exception& e)
+                    {
+                        std::cout << "Auth refresh failed for " << name <<
+                            ": " << e.what() << std::endl;
+                        store(key, HttpStatusCode::unknown);
+                    }
+                    --m_refreshes;
+                });
+                break;
+            }
+
+            case State::Missing:
+                missing.push_back(i);
+                break;
+
+            case State::Pending:
+                waiting.push_back(i);
+                break;
+        }
+    });
+
+    for (std::size_t i(0); i < names.size(); ++i)
+    {
+        keys.push_back(id + '\0' + names[i]);
+        handle(i, lookup(keys[i], codes[i]));
     }
-    for (const auto q : m_queries)
+
+    // Resolve our own pending keys before waiting on those of others, so that
+    // two requests each waiting on a key held by the other cannot deadlock.
+    if (missing.size() == 1)
     {
-        auto it(inQuery.find(q));
-        const std::string val(it != inQuery.end() ? it->second : "");
-        id += val + "-";
+        const std::size_t i(missing.front());
+        forward();
+        codes[i] = resolve(keys[i], names[i], *h, *q);
     }
+    else if (missing.size() > 1)
+    {
+        forward();
 
-    const auto now(getNow());
+        std::mutex mutex;
+        std::exception_ptr error;
 
-    std::unique_lock<std::mutex> outerLock(m_mutex);
-    Entry& entry(m_map[id][resource]);
+        entwine::Pool pool(std::min<std::size_t>(missing.size(), 8));
+        for (const std::size_t i : missing)
+        {
+            pool.add([&, i]()
+            {
+                try
+                {
+                    codes[i] = resolve(keys[i], names[i], *h, *q);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!error) error = std::current_exception();
+                }
+            });
+        }
+        pool.join();
 
-    std::unique_lock<std::mutex> lock(entry.mutex());
-    outerLock.unlock();
+        if (error) std::rethrow_exception(error);
+    }
 
-    if (
-            ( entry.ok() && secondsBetween(entry.checked(), now) > m_good) ||
-            (!entry.ok() && secondsBetween(entry.checked(), now) > m_bad))
+    // If another request's check failed, the key is missing once more and
+    // we check it ourselves - right away, so that we never wait while
+    // holding a pending key.
+    for (const std::size_t i : waiting)
     {
-        std::cout << "Authing " << id << std::endl;
-        const ArbiterHeaders h(req.header.begin(), req.header.end());
-        const ArbiterQuery q(inQuery.begin(), inQuery.end());
+        const State state(await(keys[i], codes[i]));
+        if (state == State::Missing)
+        {
+            forward();
+            codes[i] = resolve(keys[i], names[i], *h, *q);
+        }
+        else handle(i, state);
+    }
 
-        entry.set(m_ep.httpGet(resource, h, q).code());
+    for (std::size_t i(0); i < names.size(); ++i)
+    {
+        if (!ok(codes[i])) return std::make_pair(names[i], codes[i]);
     }
 
-    return entry.code();
+    return std::make_pair(std::string(), HttpStatusCode::success_ok);
+}
+
+Auth::State Auth::lookup(const std::string& key, HttpStatusCode& code)
+{
+    Shard& s(shard(key));
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    auto missing([&]()
+    {
+        if (s.pending.count(key)) return State::Pending;
+        s.pending.insert(key);
+        return State::Missing;
+    });
+
+    auto it(s.entries.find(key));
+    if (it == s.entries.end()) return missing();
+
+    Entry& entry(it->second);
+    s.order.splice(s.order.begin(), s.order, entry.order);
+
+    const std::size_t age(secondsSince(entry.checked));
+    const std::size_t ttl(ok(entry.code) ? m_good : m_bad);
+
+    if (age <= ttl)
+    {
+        code = entry.code;
+        return State::Fresh;
+    }
+
+    // Only successful results may be served stale, and only for a short
+    // grace period while a refresh is in progress - otherwise a revoked
+    // credential would keep its access.  Beyond that, or if the refresh
+    // queue is full, they must be checked synchronously.
+    if (!ok(entry.code) || age > ttl + m_stale) return missing();
+
+    code = entry.code;
+    if (entry.refreshing) return State::Fresh;
+
+    if (m_refreshes++ >= maxRefreshes)
+    {
+        --m_refreshes;
+        return missing();
+    }
+
+    entry.refreshing = true;
+    return State::Stale;
+}
+
+Auth::State Auth::await(const std::string& key, HttpStatusCode& code)
+{
+    State state(State::Pending);
+    while (state == State::Pending)
+    {
+        {
+            Shard& s(shard(key));
+            std::unique_lock<std::mutex> lock(s.mutex);
+            s.cv.wait(lock, [&]() { return !s.pending.count(key); });
+        }
+
+        state = lookup(key, code);
+    }
+    return state;
+}
+
+HttpStatusCode Auth::resolve(
+        const std::string& key,
+        const std::string& name,
+        const ArbiterHeaders& h,
+        const ArbiterQuery& q)
+{
+    try
+    {
+        const HttpStatusCode code(fetch(name, h, q));
+        store(key, code);
+        release(key);
+        return code;
+    }
+    catch (...)
+    {
+        release(key);
+        throw;
+    }
+}
+
+HttpStatusCode Auth::fetch(
+        const std::string& name,
+        const ArbiterHeaders& h,
+        const ArbiterQuery& q) const
+{
+    std::cout << "Authing " << name << std::endl;
+    return static_cast<HttpStatusCode>(m_ep.httpGet(name, h, q).code());
+}
+
+void Auth::store(const std::string& key, const HttpStatusCode code)
+{
+    Shard& s(shard(key));
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    auto it(s.entries.find(key));
+
+    // A failed refresh keeps the existing result, which will be retried or
+    // expire as usual.
+    if (code == HttpStatusCode::unknown)
+    {
+        if (it != s.entries.end()) it->second.refreshing = false;
+        return;
+    }
+
+    if (it == s.entries.end())
+    {
+        s.order.push_front(key);
+        it = s.entries.emplace(key, Entry()).first;
+        it->second.order = s.order.begin();
+
+        if (s.entries.size() > m_maxEntries / numShards)
+        {
+            const std::string oldest(s.order.back());
+            s.order.pop_back();
+            s.entries.erase(oldest);
+        }
+    }
+
+    Entry& entry(it->second);
+    entry.code = code;
+    entry.checked = getNow();
+    entry.refreshing = false;
+}
+
+void Auth::release(const std::string& key)
+{
+    Shard& s(shard(key));
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.pending.erase(key);
+    }
+    s.cv.notify_all();
 }
 
 std::unique_ptr<Auth> Auth::maybeCreate(
@@ -178,12 +443,22 @@ std::unique_ptr<Auth> Auth::maybeCreate(
                     time["bad"].asDouble() * 60.0 :
                     time.asDouble() * 60.0);
 
+        const std::size_t stale(
+                auth.isMember("staleSeconds") ?
+                    auth["staleSeconds"].asUInt64() : 60);
+
+        const std::size_t maxEntries(
+                auth.isMember("maxEntries") ?
+                    auth["maxEntries"].asUInt64() : 100000);
+
         return entwine::makeUnique<Auth>(
                 a.getEndpoint(auth["path"].asString()),
                 cookies,
                 queries,
                 good,
-                bad);
+                bad,
+                stale,
+                maxEntries);
     }
     else return std::unique_ptr<Auth>();
 }
@@ -191,5 +466,12 @@ std::unique_ptr<Auth> Auth::maybeCreate(
 template HttpStatusCode Auth::check(const std::string&, Http::Request&);
 template HttpStatusCode Auth::check(const std::string&, Https::Request&);
 
+template std::pair<std::string, HttpStatusCode> Auth::check(
+        const std::vector<std::string>&,
+        Http::Request&);
+template std::pair<std::string, HttpStatusCode> Auth::check(
+        const std::vector<std::string>&,
+        Https::Request&);
+
 } // namespace greyhound
 
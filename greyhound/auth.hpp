@@ -1,8 +1,18 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include <entwine/third/arbiter/arbiter.hpp>
+#include <entwine/util/pool.hpp>
 
 #include <greyhound/defs.hpp>
 #include <greyhound/configuration.hpp>
@@ -18,7 +28,9 @@ public:
             std::vector<std::string> cookies,
             std::vector<std::string> queries,
             std::size_t good,
-            std::size_t bad);
+            std::size_t bad,
+            std::size_t stale,
+            std::size_t maxEntries);
 
     static std::unique_ptr<Auth> maybeCreate(
         const Configuration& config,
@@ -27,45 +39,99 @@ public:
     template<typename Req>
     HttpStatusCode check(const std::string& name, Req& req);
 
+    // Check all of the given resources for a single request, for example
+    // the components of an alias.  Any that are not cached are requested
+    // from the auth server concurrently.  Returns the first failure along
+    // with its resource name, or an empty name if all checks passed.
+    template<typename Req>
+    std::pair<std::string, HttpStatusCode> check(
+            const std::vector<std::string>& names,
+            Req& req);
+
     const std::vector<std::string>& cookies() const { return m_cookies; }
     const std::vector<std::string>& queries() const { return m_queries; }
 
     std::string path() const { return m_ep.prefixedRoot(); }
     std::size_t goodSeconds() const { return m_good; }
     std::size_t badSeconds() const { return m_bad; }
+    std::size_t staleSeconds() const { return m_stale; }
+    std::size_t maxEntries() const { return m_maxEntries; }
 
-    class Entry
+private:
+    struct Entry
     {
-    public:
-        void set(int c)
-        {
-            m_code = static_cast<HttpStatusCode>(c);
-            m_checked = getNow();
-        }
-
-        const TimePoint& checked() const { return m_checked; }
-        HttpStatusCode code() const { return m_code; }
-        bool ok() const { return greyhound::ok(m_code); }
-        std::mutex& mutex() const { return m_mutex; }
-
-    private:
-        HttpStatusCode m_code = HttpStatusCode::client_error_unauthorized;
-        TimePoint m_checked;
-        mutable std::mutex m_mutex;
+        HttpStatusCode code = HttpStatusCode::client_error_unauthorized;
+        TimePoint checked;
+        bool refreshing = false;
+        std::list<std::string>::iterator order;
     };
 
-private:
+    // Entries are spread across shards by key, each independently locked
+    // and bounded in least-recently-used order.  Keys being checked
+    // synchronously are pending, and other requests for them wait on the
+    // condition variable rather than checking them again.
+    struct Shard
+    {
+        std::unordered_map<std::string, Entry> entries;
+        std::list<std::string> order;
+        std::unordered_set<std::string> pending;
+        std::mutex mutex;
+        std::condition_variable cv;
+    };
+
+    static constexpr std::size_t numShards = 16;
+    static constexpr std::size_t maxRefreshes = 1024;
+
+    Shard& shard(const std::string& key)
+    {
+        return m_shards[std::hash<std::string>()(key) % numShards];
+    }
+
+    enum class State { Fresh, Stale, Missing, Pending };
+
+    // Look up a cached result, marking stale entries as being refreshed so
+    // that only one refresh is scheduled for each.  A missing key - or one
+    // whose result may not be served stale - is marked as pending, and the
+    // caller must then resolve it.  If it is already pending, the caller
+    // should wait for it.
+    State lookup(const std::string& key, HttpStatusCode& code);
+
+    // Wait until the key is no longer pending, then look it up again.
+    State await(const std::string& key, HttpStatusCode& code);
+
+    // Fetch and store the result for a pending key, releasing it even if
+    // the fetch throws.
+    HttpStatusCode resolve(
+            const std::string& key,
+            const std::string& name,
+            const ArbiterHeaders& h,
+            const ArbiterQuery& q);
+
+    HttpStatusCode fetch(
+            const std::string& name,
+            const ArbiterHeaders& h,
+            const ArbiterQuery& q) const;
+
+    void store(const std::string& key, HttpStatusCode code);
+    void release(const std::string& key);
+
     const entwine::arbiter::Endpoint m_ep;
     std::vector<std::string> m_cookies;
     std::vector<std::string> m_queries;
     const std::size_t m_good;
     const std::size_t m_bad;
+    const std::size_t m_stale;
+    const std::size_t m_maxEntries;
+
+    std::array<Shard, numShards> m_shards;
 
-    using UserId = std::string;
-    using ResourceName = std::string;
-    std::map<UserId, std::map<ResourceName, Entry>> m_map;
-    mutable std::mutex m_mutex;
+    // Background refreshes that are queued or running, bounded so that
+    // scheduling one never blocks.
+    std::atomic<std::size_t> m_refreshes;
+
+    // Declared last, so that pending refreshes finish before the shards
+    // they update are destroyed.
+    entwine::Pool m_pool;
 };
 
 } // namespace greyhound
-
@@ -0,0 +1,164 @@
+#include <greyhound/buffer-pool.hpp>
+
+#include <algorithm>
+
+namespace greyhound
+{
+
+namespace
+{
+
+std::atomic<uint64_t> nextId(1);
+
+// Smallest shift such that (1 << shift) >= n.
+std::size_t ceilShift(std::size_t n)
+{
+    std::size_t shift(0);
+    while ((std::size_t(1) << shift) < n) ++shift;
+    return shift;
+}
+
+// Largest shift such that (1 << shift) <= n, for nonzero n.
+std::size_t floorShift(std::size_t n)
+{
+    std::size_t shift(0);
+    while (n >>= 1) ++shift;
+    return shift;
+}
+
+} // unnamed namespace
+
+BufferPool::BufferPool(const std::size_t maxBytes)
+    : m_maxBytes(maxBytes)
+    , m_id(nextId++)
+{ }
+
+Data BufferPool::acquire(const std::size_t bytes)
+{
+    Data data;
+
+    const std::size_t shift(std::max(ceilShift(bytes), minShift));
+    if (shift > maxShift || !m_maxBytes)
+    {
+        ++m_misses;
+        data.reserve(bytes);
+        return data;
+    }
+
+    const std::size_t c(shift - minShift);
+
+    if (take((*local(true))[c], data)) return data;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (take(m_lists[c], data)) return data;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_localsMutex);
+        reclaim();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (take(m_lists[c], data)) return data;
+    }
+
+    ++m_misses;
+    data.reserve(std::size_t(1) << shift);
+    return data;
+}
+
+void BufferPool::release(Data&& data)
+{
+    const std::size_t capacity(data.capacity());
+    if (!capacity || !m_maxBytes) return;
+
+    const std::size_t shift(floorShift(capacity));
+    if (shift < minShift || shift > maxShift) return;
+
+    const std::size_t c(shift - minShift);
+    data.clear();
+
+    if (!retain(capacity)) return;
+
+    if (Lists* lists = local(false))
+    {
+        auto& list((*lists)[c]);
+        if (list.size() < localBuffers)
+        {
+            list.push_back(std::move(data));
+            return;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_lists[c].push_back(std::move(data));
+}
+
+bool BufferPool::retain(const std::size_t bytes)
+{
+    std::size_t current(m_retained.load());
+    do
+    {
+        if (current + bytes > m_maxBytes) return false;
+    }
+    while (!m_retained.compare_exchange_weak(current, current + bytes));
+
+    return true;
+}
+
+bool BufferPool::take(std::vector<Data>& list, Data& data)
+{
+    if (list.empty()) return false;
+
+    data = std::move(list.back());
+    list.pop_back();
+
+    m_retained -= data.capacity();
+    ++m_hits;
+    return true;
+}
+
+BufferPool::Lists* BufferPool::local(const bool create)
+{
+    thread_local uint64_t owner(0);
+    thread_local std::shared_ptr<Lists> lists;
+
+    if (owner != m_id)
+    {
+        if (!create) return nullptr;
+
+        lists = std::make_shared<Lists>();
+        owner = m_id;
+
+        std::lock_guard<std::mutex> lock(m_localsMutex);
+        reclaim();
+        m_locals.push_back(lists);
+    }
+
+    return lists.get();
+}
+
+void BufferPool::reclaim()
+{
+    for (auto it(m_locals.begin()); it != m_locals.end(); )
+    {
+        if (it->use_count() > 1)
+        {
+            ++it;
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (std::size_t c(0); c < numClasses; ++c)
+        {
+            for (Data& data : (**it)[c]) m_lists[c].push_back(std::move(data));
+        }
+
+        it = m_locals.erase(it);
+    }
+}
+
+} // namespace greyhound
+
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <greyhound/defs.hpp>
+
+namespace greyhound
+{
+
+// Recycles large buffers across requests to avoid constant malloc/free churn
+// and the resulting heap fragmentation.  Buffers are grouped into
+// power-of-two size classes by capacity.  Each thread that acquires buffers
+// keeps a small cache of its own, backed by a shared pool limited to a total
+// number of retained bytes.  Threads that only release buffers return them
+// to the shared pool, and the caches of exited threads are returned to it
+// too.
+class BufferPool
+{
+public:
+    BufferPool(std::size_t maxBytes);
+
+    // Returns an empty buffer with a capacity of at least the given size.
+    Data acquire(std::size_t bytes);
+
+    // Returns a buffer for reuse.  Buffers outside of the size classes, or
+    // beyond the retention limit, are simply freed.
+    void release(Data&& data);
+
+    // Holds an acquired buffer, and releases it when destroyed - including
+    // while unwinding from an exception.
+    class Lease
+    {
+    public:
+        Lease(BufferPool& pool, std::size_t bytes)
+            : m_pool(pool)
+            , m_data(pool.acquire(bytes))
+        { }
+
+        ~Lease() { m_pool.release(std::move(m_data)); }
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        Data& data() { return m_data; }
+
+    private:
+        BufferPool& m_pool;
+        Data m_data;
+    };
+
+    uint64_t hits() const { return m_hits; }
+    uint64_t misses() const { return m_misses; }
+    std::size_t retainedBytes() const { return m_retained; }
+    std::size_t maxBytes() const { return m_maxBytes; }
+
+private:
+    static constexpr std::size_t minShift = 16;
+    static constexpr std::size_t maxShift = 26;
+    static constexpr std::size_t numClasses = maxShift - minShift + 1;
+
+    // Buffers retained per size class by each thread, without locking.
+    static constexpr std::size_t localBuffers = 2;
+
+    using Lists = std::array<std::vector<Data>, numClasses>;
+
+    // The calling thread's cache, or null if it has none and `create` is
+    // false.
+    Lists* local(bool create);
+    bool take(std::vector<Data>& list, Data& data);
+
+    // Count the given bytes as retained, unless that would exceed the limit.
+    bool retain(std::size_t bytes);
+
+    // Move the buffers of caches whose threads have exited into the shared
+    // pool.  Requires m_localsMutex to be held.
+    void reclaim();
+
+    const std::size_t m_maxBytes;
+    const uint64_t m_id;
+
+    std::atomic<uint64_t> m_hits{0};
+    std::atomic<uint64_t> m_misses{0};
+    std::atomic<std::size_t> m_retained{0};
+
+    Lists m_lists;
+    std::mutex m_mutex;
+
+    // Thread caches are shared with the thread-local registrations of the
+    // threads that created them, so a cache only owned here belongs to a
+    // thread that has exited.
+    std::vector<std::shared_ptr<Lists>> m_locals;
+    std::mutex m_localsMutex;
+};
+
+} // namespace greyhound
+
@@ -1,16 +1,32 @@
 #pragma once
 
 #include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <utility>
+#include <vector>
 
+#include <pdal/compression/LazPerfCompression.hpp>
+
+#include <entwine/util/unique.hpp>
+
+#include <greyhound/buffer-pool.hpp>
 #include <greyhound/defs.hpp>
+#include <greyhound/trace.hpp>
 
 namespace greyhound
 {
 
+// Output stream adapter for pdal::LazPerfCompressor, which appends encoded
+// bytes to an existing buffer.
 class Stream
 {
 public:
+    explicit Stream(Data& data) : m_data(data) { }
+
     void putBytes(const uint8_t* bytes, std::size_t length)
     {
         m_data.insert(m_data.end(), bytes, bytes + length);
@@ -21,41 +37,168 @@ public:
         m_data.push_back(reinterpret_cast<const char&>(byte));
     }
 
-    std::vector<char>& data()
+    Data& data()
     {
         return m_data;
     }
 
 private:
-    std::vector<char> m_data;
+    Data& m_data;
+};
+
+// Sends chunks to the client asynchronously.  Producers enqueue chunks and
+// return immediately unless too many chunks are already pending, and each
+// completed send starts the next one from within the event loop.  This
+// state is shared with the pending send callbacks, so it outlives the
+// Chunker - whose producer may therefore return before the client has
+// received everything.
+template<typename Res>
+class Sender : public std::enable_shared_from_this<Sender<Res>>
+{
+public:
+    Sender(std::shared_ptr<Res> res, BufferPool& pool)
+        : m_res(res)
+        , m_pool(pool)
+    { }
+
+    // Block while the queue is full, so a slow client applies backpressure
+    // to its producer rather than accumulating unbounded memory.  Trailer
+    // fields may accompany the last chunk, each terminated by CRLF.
+    void push(Data&& chunk, bool last, const std::string& trailer = "")
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]()
+        {
+            return m_ec || m_queue.size() < maxQueued;
+        });
+
+        if (m_ec || m_aborted)
+        {
+            m_pool.release(std::move(chunk));
+            return;
+        }
+
+        if (last) m_trailer = trailer;
+
+        m_queue.emplace_back(std::move(chunk), last);
+        if (!m_sending) next();
+    }
+
+    bool canceled() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_aborted || m_ec == SimpleWeb::errc::broken_pipe;
+    }
+
+    // Give up on a response whose body is partially sent, dropping anything
+    // not yet sent.  The connection is closed once the send in progress, if
+    // any, completes - without the final chunk, so that the client sees a
+    // truncated body.
+    void abort()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_aborted = true;
+        for (auto& p : m_queue) m_pool.release(std::move(p.first));
+        m_queue.clear();
+        m_res->close_connection_after_response = true;
+        m_cv.notify_all();
+    }
+
+private:
+    static constexpr std::size_t maxQueued = 4;
+
+    // Must be called while holding m_mutex.
+    void next()
+    {
+        const auto& chunk(m_queue.front().first);
+        Res& res(*m_res);
+
+        if (chunk.size())
+        {
+            res << std::hex << chunk.size() << "\r\n";
+            res.write(chunk.data(), chunk.size());
+            res << "\r\n";
+        }
+
+        if (m_queue.front().second) res << "0\r\n" << m_trailer << "\r\n";
+
+        // The chunk has been copied into the response, so its buffer may be
+        // reused right away.
+        m_pool.release(std::move(m_queue.front().first));
+        m_queue.pop_front();
+        m_sending = true;
+        m_cv.notify_all();
+
+        auto self(this->shared_from_this());
+        res.send([self](const SimpleWeb::error_code& ec)
+        {
+            self->sent(ec);
+        });
+    }
+
+    void sent(const SimpleWeb::error_code& ec)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_sending = false;
+
+        if (ec)
+        {
+            m_ec = ec;
+            for (auto& p : m_queue) m_pool.release(std::move(p.first));
+            m_queue.clear();
+        }
+        else if (!m_queue.empty() && !m_aborted) next();
+
+        m_cv.notify_all();
+    }
+
+    std::shared_ptr<Res> m_res;
+    BufferPool& m_pool;
+    std::deque<std::pair<Data, bool>> m_queue;
+    std::string m_trailer;
+    bool m_sending = false;
+    bool m_aborted = false;
+    SimpleWeb::error_code m_ec;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
 };
 
 template<typename Res>
 class Chunker
 {
 public:
-    Chunker(Res& res, const Headers& headers)
+    Chunker(Res& res, const Headers& headers, BufferPool& pool)
         : m_res(res)
         , m_headers(headers)
+        , m_pool(pool)
+        , m_data(m_pool.acquire(chunkBytes * 2))
     {
-        m_data.reserve(262144 * 4);
         m_headers.emplace("Content-Type", "binary/octet-stream");
     }
 
+    // If we are unwinding from an exception after the headers were sent, an
+    // error response can no longer be written, so the response is aborted
+    // instead.  Its connection is then marked to be closed, which tells the
+    // router that the response has been dealt with.
     ~Chunker()
     {
         try
         {
-            if (!m_done && m_headersSent) done();
-        }
-        catch (std::exception& e)
-        {
-            std::cout << "~Chunker: " << e.what() << std::endl;
+            if (!m_done && m_headersSent)
+            {
+                if (std::uncaught_exception()) m_sender->abort();
+                else done();
+            }
         }
         catch (...)
         {
-            std::cout << "~Chunker: unknown error" << std::endl;
+            // The response could not be finished, so it can't be completed.
+            m_sender->abort();
         }
+
+        for (Data& b : m_buffers) m_pool.release(std::move(b));
+        m_pool.release(std::move(m_data));
     }
 
     void write(bool last = false)
@@ -64,82 +207,214 @@ public:
 
         if (!m_headersSent)
         {
-            if (last)
+            if (last && m_whole)
             {
+                Trace::Scope scope("flush");
+                record();
+                m_bytes += pending();
+                if (m_buffers.empty()) m_whole(m_headers, m_data);
+                else
+                {
+                    Data all(m_pool.acquire(pending()));
+                    for (const Data& b : m_buffers)
+                    {
+                        all.insert(all.end(), b.begin(), b.end());
+                    }
+                    all.insert(all.end(), m_data.begin(), m_data.end());
+                    m_whole(m_headers, all);
+                    m_pool.release(std::move(all));
+                }
+                for (Data& b : m_buffers) m_pool.release(std::move(b));
+                m_buffers.clear();
+                m_done = true;
+                return;
+            }
+            else if (last)
+            {
+                Trace::Scope scope("flush");
+                Trace::stamp(m_headers);
                 m_headers.emplace(
                         "Content-Length",
-                        std::to_string(m_data.size()));
+                        std::to_string(pending()));
+                record();
+                m_bytes += pending();
                 m_res.write(m_headers);
+                for (const Data& b : m_buffers) m_res.write(b.data(), b.size());
                 m_res.write(m_data.data(), m_data.size());
+                for (Data& b : m_buffers) m_pool.release(std::move(b));
+                m_buffers.clear();
                 m_done = true;
                 return;
             }
+            else if (pending() <= chunkBytes)
+            {
+                // Keep buffering small responses so they can be sent with a
+                // Content-Length rather than as a chunked stream.
+                return;
+            }
             else
             {
+                // The headers are sent along with the first chunk.  Any
+                // Server-Timing is repeated as a trailer once complete.
+                Trace::stamp(m_headers);
+                if (m_headers.find("Server-Timing") != m_headers.end())
+                {
+                    m_headers.emplace("Trailer", "Server-Timing");
+                }
                 m_headers.emplace("Transfer-Encoding", "chunked");
                 m_res.write(m_headers);
+                m_sender = std::make_shared<Sender<Res>>(
+                        m_res.shared_from_this(),
+                        m_pool);
             }
 
             m_headersSent = true;
         }
 
         if (last) done();
-        else if (m_data.size() > 65536)
+        else if (pending() > chunkBytes) flush(false);
+    }
+
+    // Take ownership of a buffer to be sent after everything already added.
+    // Large buffers are sent as their own chunks rather than being copied
+    // into data().
+    void append(Data&& buffer)
+    {
+        if (buffer.size() < chunkBytes)
+        {
+            m_data.insert(m_data.end(), buffer.begin(), buffer.end());
+            m_pool.release(std::move(buffer));
+            return;
+        }
+
+        if (!m_data.empty())
         {
-            writeChunk();
-            flush();
+            m_buffers.push_back(m_pool.acquire(chunkBytes * 2));
+            std::swap(m_buffers.back(), m_data);
         }
+
+        m_buffers.push_back(std::move(buffer));
     }
 
     Data& data() { return m_data; }
-    bool canceled() const { return m_ec == SimpleWeb::errc::broken_pipe; }
+
+    // Retain a copy of everything sent, as long as the total stays within
+    // maxBytes, so the finished response can be cached.
+    void capture(std::size_t maxBytes)
+    {
+        m_capture = entwine::makeUnique<Data>();
+        m_captureBytes = maxBytes;
+    }
+
+    // Hand a response that completes before any of it has been streamed to
+    // `f`, along with our headers, to be written as a whole - for example so
+    // that it may honor a Range request.
+    void whole(std::function<void(const Headers&, const Data&)> f)
+    {
+        m_whole = std::move(f);
+    }
+
+    // Returns the full response if it was captured and completed normally.
+    std::unique_ptr<Data> captured()
+    {
+        if (m_done && !canceled()) return std::move(m_capture);
+        return std::unique_ptr<Data>();
+    }
+
+    // Whether the headers have been sent, after which an error can no longer
+    // be reported to the client.
+    bool started() const { return m_headersSent; }
+
+    // Number of payload bytes handed off to the client so far.
+    std::size_t bytes() const { return m_bytes; }
+
+    bool canceled() const { return m_sender && m_sender->canceled(); }
     bool cancelled() const { return canceled(); }
 
 private:
+    // Buffered data beyond this size is flushed to the client as a chunk.
+    static constexpr std::size_t chunkBytes = 65536;
+
     void done()
     {
-        if (m_data.size()) writeChunk();
-        m_res << "0\r\n\r\n";
-
-        flush();
+        flush(true);
         m_done = true;
     }
 
-    void writeChunk()
+    // Bytes added but not yet handed off.
+    std::size_t pending() const
     {
-        if (m_data.size())
+        std::size_t n(m_data.size());
+        for (const Data& b : m_buffers) n += b.size();
+        return n;
+    }
+
+    void record()
+    {
+        if (!m_capture) return;
+
+        if (m_capture->size() + pending() > m_captureBytes)
+        {
+            m_capture.reset();
+            return;
+        }
+
+        for (const Data& b : m_buffers)
         {
-            m_res << std::hex << m_data.size() << "\r\n";
-            m_res.write(m_data.data(), m_data.size());
-            m_res << "\r\n";
+            m_capture->insert(m_capture->end(), b.begin(), b.end());
         }
+        m_capture->insert(m_capture->end(), m_data.begin(), m_data.end());
     }
 
-    void flush()
+    void flush(bool last)
     {
-        m_res.send([this](const SimpleWeb::error_code& ec)
-        {
-            m_ec = ec;
-            m_data.clear();
-            m_cv.notify_all();
-        });
+        Trace::Scope scope("flush");
 
-        std::unique_lock<std::mutex> lock(m_mutex);
-        m_cv.wait(lock, [this]() { return m_data.empty(); });
+        record();
+        m_bytes += pending();
+
+        // Hand our buffers off to the sender without copying them.
+        for (Data& b : m_buffers) m_sender->push(std::move(b), false);
+        m_buffers.clear();
+
+        // Note that m_data itself must remain the same object, since the
+        // compression Stream refers to it.
+        Data chunk(m_pool.acquire(chunkBytes * 2));
+        std::swap(chunk, m_data);
+
+        m_sender->push(std::move(chunk), last, last ? trailer() : "");
         if (canceled()) m_done = true;
     }
 
+    // The final Server-Timing, if the headers included one.
+    std::string trailer() const
+    {
+        Headers h;
+        if (m_headers.find("Server-Timing") == m_headers.end()) return "";
+
+        h.emplace("Server-Timing", "");
+        Trace::stamp(h);
+        return "Server-Timing: " + h.begin()->second + "\r\n";
+    }
+
     Res& m_res;
     Headers m_headers;
+    BufferPool& m_pool;
 
     Data m_data;
 
-    SimpleWeb::error_code m_ec;
+    // Buffers taken by append, which are sent before m_data.
+    std::vector<Data> m_buffers;
+
+    std::unique_ptr<Data> m_capture;
+    std::size_t m_captureBytes = 0;
+
+    std::function<void(const Headers&, const Data&)> m_whole;
+
+    std::shared_ptr<Sender<Res>> m_sender;
+    std::size_t m_bytes = 0;
     bool m_headersSent = false;
     bool m_done = false;
-    std::condition_variable m_cv;
-    mutable std::mutex m_mutex;
 };
 
 } // namespace greyhound
-
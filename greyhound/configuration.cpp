@@ -13,6 +13,7 @@ Json::Value defaults()
 {
     Json::Value json;
     json["cacheSize"] = "200MB";
+    json["bufferPoolSize"] = "64MB";
     json["paths"] = entwine::toJsonArray(
             std::vector<std::string>{
                 "/greyhound", "~/greyhound",
@@ -21,7 +22,15 @@ Json::Value defaults()
             });
     json["tmp"] = entwine::arbiter::fs::getTempPath();
     json["resourceTimeoutMinutes"] = 30;
+    json["openTimeoutSeconds"] = 30;
+    json["notFoundTimeoutSeconds"] = 30;
+    json["tracing"]["serverTiming"] = true;
     json["http"]["port"] = 8080;
+    json["http"]["ioThreads"] = 1;
+    json["http"]["acceptors"] = 1;
+    json["http"]["compression"]["minBytes"] = 1024;
+    json["http"]["compression"]["codings"] = entwine::toJsonArray(
+            std::vector<std::string>{ "br", "gzip" });
 
     Json::Value headers;
     headers["Cache-Control"] = "public, max-age=300";
@@ -0,0 +1,279 @@
+#include <greyhound/converter.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+
+#include <entwine/util/unique.hpp>
+
+namespace greyhound
+{
+
+namespace
+{
+
+using Type = pdal::Dimension::Type;
+
+enum class Kind { Unsigned, Signed, Floating, None };
+
+Kind kind(const Type t)
+{
+    switch (t)
+    {
+        case Type::Unsigned8:
+        case Type::Unsigned16:
+        case Type::Unsigned32:
+        case Type::Unsigned64:
+            return Kind::Unsigned;
+        case Type::Signed8:
+        case Type::Signed16:
+        case Type::Signed32:
+        case Type::Signed64:
+            return Kind::Signed;
+        case Type::Float:
+        case Type::Double:
+            return Kind::Floating;
+        default:
+            return Kind::None;
+    }
+}
+
+std::size_t size(const Type t)
+{
+    switch (t)
+    {
+        case Type::Unsigned8:   case Type::Signed8:     return 1;
+        case Type::Unsigned16:  case Type::Signed16:    return 2;
+        case Type::Unsigned32:  case Type::Signed32:    return 4;
+        case Type::Float:                               return 4;
+        case Type::Unsigned64:  case Type::Signed64:    return 8;
+        case Type::Double:                              return 8;
+        default:                                        return 0;
+    }
+}
+
+// True if every value of type `in` is exactly representable as type `out`.
+bool lossless(const Type in, const Type out)
+{
+    if (in == out) return true;
+
+    const Kind a(kind(in)), b(kind(out));
+    const std::size_t x(size(in)), y(size(out));
+
+    if (a == Kind::None || b == Kind::None) return false;
+    if (a == b) return y > x;
+    if (a == Kind::Unsigned && b == Kind::Signed) return y > x;
+
+    // Float holds 24 bits of mantissa and double holds 53.
+    if (b == Kind::Floating) return a != Kind::Floating && x * 2 <= y;
+
+    return false;
+}
+
+bool spatial(const std::string& name)
+{
+    return name == "X" || name == "Y" || name == "Z";
+}
+
+// Loads and stores go through memcpy, since point records are packed and
+// their fields are generally unaligned.  Compilers reduce these to plain
+// moves, leaving loops that they can unroll and vectorize.
+template<std::size_t N>
+void copy(
+        const char* in,
+        char* out,
+        const std::size_t np,
+        const std::size_t inStride,
+        const std::size_t outStride)
+{
+    for (std::size_t i(0); i < np; ++i)
+    {
+        std::memcpy(out, in, N);
+        in += inStride;
+        out += outStride;
+    }
+}
+
+template<typename In, typename Out>
+void widen(
+        const char* in,
+        char* out,
+        const std::size_t np,
+        const std::size_t inStride,
+        const std::size_t outStride)
+{
+    In a;
+    Out b;
+    for (std::size_t i(0); i < np; ++i)
+    {
+        std::memcpy(&a, in, sizeof(In));
+        b = static_cast<Out>(a);
+        std::memcpy(out, &b, sizeof(Out));
+        in += inStride;
+        out += outStride;
+    }
+}
+
+template<typename In>
+Converter::Kernel widenFrom(const Type out)
+{
+    switch (out)
+    {
+        case Type::Unsigned16:  return widen<In, uint16_t>;
+        case Type::Unsigned32:  return widen<In, uint32_t>;
+        case Type::Unsigned64:  return widen<In, uint64_t>;
+        case Type::Signed16:    return widen<In, int16_t>;
+        case Type::Signed32:    return widen<In, int32_t>;
+        case Type::Signed64:    return widen<In, int64_t>;
+        case Type::Float:       return widen<In, float>;
+        case Type::Double:      return widen<In, double>;
+        default:                return nullptr;
+    }
+}
+
+Converter::Kernel widener(const Type in, const Type out)
+{
+    switch (in)
+    {
+        case Type::Unsigned8:   return widenFrom<uint8_t>(out);
+        case Type::Unsigned16:  return widenFrom<uint16_t>(out);
+        case Type::Unsigned32:  return widenFrom<uint32_t>(out);
+        case Type::Signed8:     return widenFrom<int8_t>(out);
+        case Type::Signed16:    return widenFrom<int16_t>(out);
+        case Type::Signed32:    return widenFrom<int32_t>(out);
+        case Type::Float:       return widenFrom<float>(out);
+        default:                return nullptr;
+    }
+}
+
+// Fixed-width copies for the common run lengths, such as a single field or
+// XYZ as three 32-bit or 64-bit values.  Other lengths fall back to a
+// general copy.
+Converter::Kernel copier(const std::size_t bytes)
+{
+    switch (bytes)
+    {
+        case 1:     return copy<1>;
+        case 2:     return copy<2>;
+        case 4:     return copy<4>;
+        case 8:     return copy<8>;
+        case 12:    return copy<12>;
+        case 16:    return copy<16>;
+        case 24:    return copy<24>;
+        default:    return nullptr;
+    }
+}
+
+} // unnamed namespace
+
+std::unique_ptr<Converter> Converter::maybeCreate(
+        const entwine::Schema& native,
+        const entwine::Schema& out)
+{
+    struct Field
+    {
+        std::size_t offset;
+        Type type;
+    };
+
+    std::map<std::string, Field> fields;
+    std::size_t offset(0);
+    for (const auto& dim : native.dims())
+    {
+        fields[dim.name()] = Field { offset, dim.type() };
+        offset += dim.size();
+    }
+
+    if (!offset || !out.pointSize()) return std::unique_ptr<Converter>();
+
+    std::unique_ptr<Converter> converter(
+            new Converter(native.pointSize(), out.pointSize()));
+    auto& ops(converter->m_ops);
+
+    bool identical(out.dims().size() == native.dims().size());
+    offset = 0;
+
+    for (const auto& dim : out.dims())
+    {
+        const auto it(fields.find(dim.name()));
+        if (it == fields.end()) return std::unique_ptr<Converter>();
+
+        const Field& field(it->second);
+        const Type type(dim.type());
+
+        if (!lossless(field.type, type)) return std::unique_ptr<Converter>();
+        if (field.type != type && spatial(dim.name()))
+        {
+            return std::unique_ptr<Converter>();
+        }
+
+        if (field.offset != offset || field.type != type) identical = false;
+
+        if (field.type == type)
+        {
+            // Extend the previous copy if this field directly follows it in
+            // both layouts.
+            if (
+                    !ops.empty() &&
+                    !ops.back().kernel &&
+                    ops.back().inOffset + ops.back().bytes == field.offset &&
+                    ops.back().outOffset + ops.back().bytes == offset)
+            {
+                ops.back().bytes += dim.size();
+            }
+            else
+            {
+                ops.push_back(Op { field.offset, offset, dim.size(), nullptr });
+            }
+        }
+        else
+        {
+            const Kernel kernel(widener(field.type, type));
+            if (!kernel) return std::unique_ptr<Converter>();
+            ops.push_back(Op { field.offset, offset, dim.size(), kernel });
+        }
+
+        offset += dim.size();
+    }
+
+    if (identical) return std::unique_ptr<Converter>();
+
+    // Copies are resolved last, once runs have been merged.  A null kernel
+    // now marks a copy of some other length.
+    for (Op& op : ops)
+    {
+        if (!op.kernel) op.kernel = copier(op.bytes);
+    }
+
+    return converter;
+}
+
+void Converter::convert(const Data& in, Data& out) const
+{
+    const std::size_t np(in.size() / m_inPointSize);
+    out.resize(np * m_outPointSize);
+
+    for (const Op& op : m_ops)
+    {
+        const char* src(in.data() + op.inOffset);
+        char* dst(out.data() + op.outOffset);
+
+        if (op.kernel)
+        {
+            op.kernel(src, dst, np, m_inPointSize, m_outPointSize);
+        }
+        else
+        {
+            for (std::size_t i(0); i < np; ++i)
+            {
+                std::memcpy(dst, src, op.bytes);
+                src += m_inPointSize;
+                dst += m_outPointSize;
+            }
+        }
+    }
+}
+
+} // namespace greyhound
+
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <entwine/types/schema.hpp>
+
+#include <greyhound/defs.hpp>
+
+namespace greyhound
+{
+
+// Packs points from a resource's native layout into a requested schema,
+// for the common cases where the requested schema only reorders, drops, or
+// losslessly widens native dimensions.  Reading in the native layout lets
+// entwine copy points directly, and the repacking here runs as fixed-width
+// strided loops rather than through a per-point, per-dimension layout.
+//
+// Spatial dimensions must keep their native types, since their values may
+// have been transformed by a scale, offset, or reprojection on the way out
+// of entwine, so that converting them here would not match converting them
+// there.
+class Converter
+{
+public:
+    // Returns null unless `out` is a different schema that can be produced
+    // from `native` per the rules above.
+    static std::unique_ptr<Converter> maybeCreate(
+            const entwine::Schema& native,
+            const entwine::Schema& out);
+
+    // Convert a buffer of native points, replacing the contents of `out`.
+    void convert(const Data& in, Data& out) const;
+
+    std::size_t inPointSize() const { return m_inPointSize; }
+    std::size_t outPointSize() const { return m_outPointSize; }
+
+    using Kernel = void(*)(
+            const char* in,
+            char* out,
+            std::size_t numPoints,
+            std::size_t inStride,
+            std::size_t outStride);
+
+private:
+    // A single kernel applied to every point, covering either one converted
+    // dimension or a run of adjacent dimensions that are copied verbatim.
+    struct Op
+    {
+        std::size_t inOffset;
+        std::size_t outOffset;
+        std::size_t bytes;
+        Kernel kernel;
+    };
+
+    Converter(std::size_t inPointSize, std::size_t outPointSize)
+        : m_inPointSize(inPointSize)
+        , m_outPointSize(outPointSize)
+    { }
+
+    const std::size_t m_inPointSize;
+    const std::size_t m_outPointSize;
+    std::vector<Op> m_ops;
+};
+
+} // namespace greyhound
+
@@ -0,0 +1,379 @@
+#include <greyhound/disk-cache.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <greyhound/encoding.hpp>
+
+namespace greyhound
+{
+
+namespace
+{
+
+// Each file holds the length of the full path as a little-endian 32-bit
+// integer, then the path itself, then the data.
+const std::size_t lengthBytes(4);
+const std::string tmpSuffix(".tmp");
+
+// The name of entwine's top-level metadata file.
+const std::string metadataName("entwine");
+
+bool endsWith(const std::string& s, const std::string& suffix)
+{
+    return s.size() >= suffix.size() &&
+        s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Closes a descriptor and unmaps a mapping.
+class Mapping
+{
+public:
+    explicit Mapping(const std::string& filename)
+        : m_fd(::open(filename.c_str(), O_RDONLY))
+    {
+        struct stat s;
+        if (m_fd < 0 || ::fstat(m_fd, &s) != 0 || !s.st_size) return;
+
+        void* p(::mmap(nullptr, s.st_size, PROT_READ, MAP_PRIVATE, m_fd, 0));
+        if (p == MAP_FAILED) return;
+
+        m_data = static_cast<const char*>(p);
+        m_size = s.st_size;
+    }
+
+    ~Mapping()
+    {
+        if (m_data) ::munmap(const_cast<char*>(m_data), m_size);
+        if (m_fd >= 0) ::close(m_fd);
+    }
+
+    const char* data() const { return m_data; }
+    std::size_t size() const { return m_size; }
+
+private:
+    const int m_fd;
+    const char* m_data = nullptr;
+    std::size_t m_size = 0;
+};
+
+bool writeAll(const int fd, const char* data, std::size_t size)
+{
+    while (size)
+    {
+        const ssize_t n(::write(fd, data, size));
+        if (n < 0) return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+} // unnamed namespace
+
+DiskCache::DiskCache(const std::string& dir, const std::size_t maxBytes)
+    : m_dir(dir)
+    , m_maxBytes(maxBytes)
+{
+    if (!entwine::arbiter::fs::mkdirp(m_dir))
+    {
+        throw std::runtime_error("Could not create disk cache dir: " + m_dir);
+    }
+
+    DIR* d(::opendir(m_dir.c_str()));
+    if (!d) throw std::runtime_error("Could not open disk cache dir: " + m_dir);
+
+    struct Found
+    {
+        Key key;
+        std::size_t bytes;
+        time_t modified;
+    };
+
+    std::vector<Found> found;
+
+    while (const dirent* e = ::readdir(d))
+    {
+        const std::string name(e->d_name);
+        const std::string filename(m_dir + "/" + name);
+
+        // Leftovers of writes interrupted by a previous shutdown.
+        if (endsWith(name, tmpSuffix))
+        {
+            ::unlink(filename.c_str());
+            continue;
+        }
+
+        if (
+                name.size() != 16 ||
+                name.find_first_not_of("0123456789abcdef") != std::string::npos)
+        {
+            continue;
+        }
+
+        struct stat s;
+        if (::stat(filename.c_str(), &s) != 0 || !S_ISREG(s.st_mode)) continue;
+
+        found.push_back(
+                Found {
+                    std::stoull(name, nullptr, 16),
+                    static_cast<std::size_t>(s.st_size),
+                    s.st_mtime });
+    }
+
+    ::closedir(d);
+
+    std::sort(
+            found.begin(),
+            found.end(),
+            [](const Found& a, const Found& b)
+            {
+                return a.modified > b.modified;
+            });
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const Found& f : found)
+    {
+        m_order.push_back(f.key);
+        m_entries[f.key] = Entry { f.bytes, std::prev(m_order.end()) };
+        m_bytes += f.bytes;
+    }
+
+    while (m_bytes > m_maxBytes && !m_order.empty()) remove(m_order.back());
+}
+
+std::string DiskCache::filename(const Key key) const
+{
+    std::ostringstream ss;
+    ss << m_dir << "/" << std::hex << std::setw(16) << std::setfill('0') <<
+        key;
+    return ss.str();
+}
+
+bool DiskCache::get(const std::string& path, std::vector<char>& data)
+{
+    const Key key(encoding::hash(path));
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_entries.count(key))
+        {
+            ++m_misses;
+            return false;
+        }
+    }
+
+    // The file may be evicted while we read it, which is harmless since its
+    // contents remain mapped until we are done.
+    const std::string name(filename(key));
+    const Mapping mapping(name);
+
+    uint32_t length(0);
+    if (mapping.size() >= lengthBytes)
+    {
+        for (std::size_t i(0); i < lengthBytes; ++i)
+        {
+            length |= static_cast<uint32_t>(
+                    static_cast<unsigned char>(mapping.data()[i])) << (8 * i);
+        }
+    }
+
+    const std::size_t begin(lengthBytes + length);
+    if (
+            mapping.size() < begin ||
+            length != path.size() ||
+            path.compare(0, length, mapping.data() + lengthBytes, length))
+    {
+        // A file removed or truncated outside of the cache is dropped, but
+        // on a hash collision the file belongs to another path and is kept.
+        if (mapping.size() < begin)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            remove(key);
+        }
+        ++m_misses;
+        return false;
+    }
+
+    data.assign(mapping.data() + begin, mapping.data() + mapping.size());
+
+    // Persist the recency for the next startup.
+    ::utimes(name.c_str(), nullptr);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    touch(key);
+    ++m_hits;
+    return true;
+}
+
+void DiskCache::insert(const std::string& path, const std::vector<char>& data)
+{
+    const std::size_t bytes(lengthBytes + path.size() + data.size());
+    if (bytes > m_maxBytes / 8) return;
+
+    const Key key(encoding::hash(path));
+    const std::string name(filename(key));
+    const std::string tmp(
+            name + "-" + std::to_string(m_sequence++) + tmpSuffix);
+
+    char length[lengthBytes];
+    for (std::size_t i(0); i < lengthBytes; ++i)
+    {
+        length[i] = static_cast<char>(path.size() >> (8 * i));
+    }
+
+    const int fd(::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
+    if (fd < 0) return;
+
+    const bool written(
+            writeAll(fd, length, lengthBytes) &&
+            writeAll(fd, path.data(), path.size()) &&
+            writeAll(fd, data.data(), data.size()));
+
+    if (::close(fd) != 0 || !written || ::rename(tmp.c_str(), name.c_str()))
+    {
+        ::unlink(tmp.c_str());
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it(m_entries.find(key));
+    if (it != m_entries.end())
+    {
+        m_bytes -= it->second.bytes;
+        m_order.erase(it->second.order);
+        m_entries.erase(it);
+    }
+
+    m_order.push_front(key);
+    m_entries[key] = Entry { bytes, m_order.begin() };
+    m_bytes += bytes;
+
+    while (m_bytes > m_maxBytes && !m_order.empty()) remove(m_order.back());
+}
+
+void DiskCache::erase(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    remove(encoding::hash(path));
+}
+
+std::size_t DiskCache::bytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytes;
+}
+
+std::size_t DiskCache::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+void DiskCache::touch(const Key key)
+{
+    auto it(m_entries.find(key));
+    if (it == m_entries.end()) return;
+
+    m_order.splice(m_order.begin(), m_order, it->second.order);
+}
+
+void DiskCache::remove(const Key key)
+{
+    auto it(m_entries.find(key));
+    if (it == m_entries.end()) return;
+
+    m_bytes -= it->second.bytes;
+    m_order.erase(it->second.order);
+    m_entries.erase(it);
+
+    ::unlink(filename(key).c_str());
+}
+
+bool CachingDriver::cacheable(const std::string& path)
+{
+    const std::size_t slash(path.find_last_of('/'));
+    const std::size_t first(slash == std::string::npos ? 0 : slash + 1);
+    return first < path.size() && std::isdigit(path[first]);
+}
+
+void CachingDriver::identify(
+        const std::string& path,
+        const std::vector<char>& data) const
+{
+    const std::size_t slash(path.find_last_of('/'));
+    if (path.substr(slash + 1) != metadataName) return;
+
+    const std::string dir(
+            slash == std::string::npos ? "" : path.substr(0, slash));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_metadata[dir] = encoding::hash(data.data(), data.size());
+}
+
+std::string CachingDriver::key(const std::string& path) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::string dir(path);
+    std::size_t slash(dir.find_last_of('/'));
+    while (slash != std::string::npos)
+    {
+        dir.resize(slash);
+
+        const auto it(m_metadata.find(dir));
+        if (it != m_metadata.end())
+        {
+            std::ostringstream ss;
+            ss << std::hex << std::setw(16) << std::setfill('0') <<
+                it->second << "/" << type() << "://" << path;
+            return ss.str();
+        }
+
+        slash = dir.find_last_of('/');
+    }
+
+    return "";
+}
+
+bool CachingDriver::get(std::string path, std::vector<char>& data) const
+{
+    const std::string k(cacheable(path) ? key(path) : "");
+    if (k.size() && m_cache.get(k, data)) return true;
+
+    auto result(m_inner.tryGetBinary(path));
+    if (!result) return false;
+
+    if (k.size()) m_cache.insert(k, *result);
+    else if (!cacheable(path)) identify(path, *result);
+
+    data = std::move(*result);
+    return true;
+}
+
+void CachingDriver::put(std::string path, const std::vector<char>& data) const
+{
+    m_inner.put(path, data);
+
+    if (!cacheable(path)) identify(path, data);
+    else
+    {
+        const std::string k(key(path));
+        if (k.size()) m_cache.erase(k);
+    }
+}
+
+} // namespace greyhound
+
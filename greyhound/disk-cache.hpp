@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <entwine/third/arbiter/arbiter.hpp>
+
+namespace greyhound
+{
+
+// A size-bounded LRU cache of remote files on local disk, behind the chunk
+// cache in memory.  Each file is stored under a name derived from a hash of
+// its full path, alongside that path to rule out collisions, and is read
+// back through a memory mapping.  Files are written to a temporary name and
+// then renamed into place, so the directory only ever holds complete
+// entries, and it is indexed again at startup with recency taken from each
+// file's modification time - so the cache survives restarts.
+class DiskCache
+{
+public:
+    DiskCache(const std::string& dir, std::size_t maxBytes);
+
+    // Returns false, leaving `data` alone, if `path` is not cached.
+    bool get(const std::string& path, std::vector<char>& data);
+    void insert(const std::string& path, const std::vector<char>& data);
+    void erase(const std::string& path);
+
+    const std::string& dir() const { return m_dir; }
+    std::size_t maxBytes() const { return m_maxBytes; }
+    std::size_t bytes() const;
+    std::size_t size() const;
+
+    uint64_t hits() const { return m_hits; }
+    uint64_t misses() const { return m_misses; }
+
+private:
+    using Key = uint64_t;
+
+    struct Entry
+    {
+        std::size_t bytes;
+        std::list<Key>::iterator order;
+    };
+
+    std::string filename(Key key) const;
+
+    // Both require m_mutex to be held.  Removal also deletes the file.
+    void touch(Key key);
+    void remove(Key key);
+
+    const std::string m_dir;
+    const std::size_t m_maxBytes;
+    std::size_t m_bytes = 0;
+
+    // Most recently used keys are at the front.
+    std::list<Key> m_order;
+    std::unordered_map<Key, Entry> m_entries;
+
+    std::atomic<uint64_t> m_hits{0};
+    std::atomic<uint64_t> m_misses{0};
+    std::atomic<uint64_t> m_sequence{0};
+
+    mutable std::mutex m_mutex;
+};
+
+// Wraps the driver for a remote storage type, so that files fetched through
+// it are kept in a DiskCache.  Only files whose names begin with a digit -
+// the data and hierarchy chunks of an index - are cached, and metadata is
+// always fetched from the source.
+//
+// A dataset may be indexed again at the same path, or appended to by another
+// server, so chunk paths alone do not identify their contents.  Each cached
+// chunk is therefore keyed by the contents of the top-level "entwine"
+// metadata file in the nearest directory above it, which is always read
+// when a dataset is opened, before any of its chunks - so the key is the
+// same from one run to the next.  Chunks are only cached once that file has
+// been seen.  Writes go to the source, and drop any cached copy.
+class CachingDriver : public entwine::arbiter::Driver
+{
+public:
+    CachingDriver(const entwine::arbiter::Driver& inner, DiskCache& cache)
+        : m_inner(inner)
+        , m_cache(cache)
+    { }
+
+    std::string type() const override { return m_inner.type(); }
+
+    std::unique_ptr<std::size_t> tryGetSize(std::string path) const override
+    {
+        return m_inner.tryGetSize(path);
+    }
+
+    void put(std::string path, const std::vector<char>& data) const override;
+
+    bool isRemote() const override { return m_inner.isRemote(); }
+
+protected:
+    bool get(std::string path, std::vector<char>& data) const override;
+
+    std::vector<std::string> glob(
+            std::string path,
+            bool verbose) const override
+    {
+        return m_inner.resolve(path, verbose);
+    }
+
+private:
+    // Empty if no metadata has been seen for this path.
+    std::string key(const std::string& path) const;
+
+    static bool cacheable(const std::string& path);
+
+    // Record the contents of a file, if it is a dataset's metadata.
+    void identify(const std::string& path, const std::vector<char>& data) const;
+
+    const entwine::arbiter::Driver& m_inner;
+    DiskCache& m_cache;
+
+    // Hash of the contents of the metadata file in each dataset directory.
+    mutable std::map<std::string, uint64_t> m_metadata;
+    mutable std::mutex m_mutex;
+};
+
+} // namespace greyhound
+
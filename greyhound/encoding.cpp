@@ -0,0 +1,373 @@
+#include <greyhound/encoding.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include <zlib.h>
+
+#ifdef GREYHOUND_BROTLI
+#include <brotli/encode.h>
+#endif
+
+namespace greyhound
+{
+namespace encoding
+{
+
+namespace
+{
+
+const std::array<std::string, 8> octants {
+    "swd", "sed", "nwd", "ned", "swu", "seu", "nwu", "neu"
+};
+
+const std::array<std::string, 4> quadrants { "sw", "se", "nw", "ne" };
+
+// Output is produced a block at a time, and input is handed to zlib in
+// pieces of at most this many blocks since its lengths are 32 bits.
+const std::size_t blockSize(65536);
+const std::size_t maxInput(blockSize * 1024);
+
+std::string trim(const std::string& s)
+{
+    const std::size_t first(s.find_first_not_of(" \t"));
+    if (first == std::string::npos) return "";
+    return s.substr(first, s.find_last_not_of(" \t") - first + 1);
+}
+
+std::string lower(std::string s)
+{
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    return s;
+}
+
+Data gzip(const Data& data)
+{
+    z_stream z;
+    std::memset(&z, 0, sizeof(z));
+
+    if (deflateInit2(
+                &z,
+                Z_DEFAULT_COMPRESSION,
+                Z_DEFLATED,
+                15 + 16,    // Maximum window, with a gzip wrapper.
+                8,
+                Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        throw std::runtime_error("Could not initialize gzip encoder");
+    }
+
+    std::unique_ptr<z_stream, int(*)(z_stream*)> guard(&z, deflateEnd);
+
+    Data out;
+    std::array<char, blockSize> block;
+    std::size_t pos(0);
+    int status(Z_OK);
+
+    while (status != Z_STREAM_END)
+    {
+        if (!z.avail_in && pos < data.size())
+        {
+            const std::size_t n(std::min(maxInput, data.size() - pos));
+            z.next_in = reinterpret_cast<Bytef*>(
+                    const_cast<char*>(data.data() + pos));
+            z.avail_in = n;
+            pos += n;
+        }
+
+        z.next_out = reinterpret_cast<Bytef*>(block.data());
+        z.avail_out = block.size();
+
+        status = ::deflate(&z, pos == data.size() ? Z_FINISH : Z_NO_FLUSH);
+        if (status != Z_OK && status != Z_STREAM_END)
+        {
+            throw std::runtime_error(
+                    "Compression failed with code " + std::to_string(status));
+        }
+
+        out.insert(
+                out.end(),
+                block.data(),
+                block.data() + block.size() - z.avail_out);
+    }
+
+    return out;
+}
+
+#ifdef GREYHOUND_BROTLI
+Data brotli(const Data& data)
+{
+    std::unique_ptr<BrotliEncoderState, void(*)(BrotliEncoderState*)> state(
+            BrotliEncoderCreateInstance(nullptr, nullptr, nullptr),
+            BrotliEncoderDestroyInstance);
+
+    if (!state) throw std::runtime_error("Could not initialize brotli encoder");
+
+    // Quality 5 compresses better than gzip at a similar speed, where the
+    // higher qualities are far slower.
+    BrotliEncoderSetParameter(state.get(), BROTLI_PARAM_QUALITY, 5);
+
+    Data out;
+    std::array<uint8_t, blockSize> block;
+    const uint8_t* in(reinterpret_cast<const uint8_t*>(data.data()));
+    std::size_t remaining(data.size());
+
+    while (!BrotliEncoderIsFinished(state.get()))
+    {
+        uint8_t* next(block.data());
+        std::size_t available(block.size());
+
+        if (!BrotliEncoderCompressStream(
+                    state.get(),
+                    BROTLI_OPERATION_FINISH,
+                    &remaining,
+                    &in,
+                    &available,
+                    &next,
+                    nullptr))
+        {
+            throw std::runtime_error("Brotli compression failed");
+        }
+
+        out.insert(out.end(), block.data(), next);
+    }
+
+    return out;
+}
+#endif
+
+void putVarint(Data& data, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        data.push_back(static_cast<char>((v & 0x7F) | 0x80));
+        v >>= 7;
+    }
+    data.push_back(static_cast<char>(v));
+}
+
+} // unnamed namespace
+
+Data hierarchy(const Json::Value& json)
+{
+    Data data;
+    if (!json.isObject()) return data;
+
+    std::deque<const Json::Value*> queue { &json };
+
+    while (!queue.empty())
+    {
+        const Json::Value& node(*queue.front());
+        queue.pop_front();
+
+        putVarint(data, node["n"].asUInt64());
+
+        uint8_t mask(0);
+        for (std::size_t i(0); i < octants.size(); ++i)
+        {
+            const Json::Value* child(nullptr);
+
+            if (node.isMember(octants[i])) child = &node[octants[i]];
+            else if (i < quadrants.size() && node.isMember(quadrants[i]))
+            {
+                child = &node[quadrants[i]];
+            }
+
+            if (child)
+            {
+                mask |= 1 << i;
+                queue.push_back(child);
+            }
+        }
+
+        data.push_back(static_cast<char>(mask));
+    }
+
+    return data;
+}
+
+uint64_t hash(const char* data, const std::size_t size, uint64_t seed)
+{
+    for (std::size_t i(0); i < size; ++i)
+    {
+        seed ^= static_cast<uint8_t>(data[i]);
+        seed *= 0x100000001b3ull;
+    }
+    return seed;
+}
+
+uint64_t hash(const std::string& s, const uint64_t seed)
+{
+    return hash(s.data(), s.size(), seed);
+}
+
+Data deflate(const Data& data)
+{
+    uLongf size(compressBound(data.size()));
+    Data out(size);
+
+    const int status(compress2(
+            reinterpret_cast<Bytef*>(out.data()),
+            &size,
+            reinterpret_cast<const Bytef*>(data.data()),
+            data.size(),
+            Z_DEFAULT_COMPRESSION));
+
+    if (status != Z_OK)
+    {
+        throw std::runtime_error(
+                "Compression failed with code " + std::to_string(status));
+    }
+
+    out.resize(size);
+    return out;
+}
+
+std::string name(const Coding coding)
+{
+    switch (coding)
+    {
+        case Coding::Gzip:      return "gzip";
+        case Coding::Brotli:    return "br";
+        default:                return "";
+    }
+}
+
+Coding coding(const std::string& name)
+{
+    if (name == "gzip") return Coding::Gzip;
+    if (name == "br" && supported(Coding::Brotli)) return Coding::Brotli;
+    if (name == "br") throw std::runtime_error("Built without brotli");
+    throw std::runtime_error("Unknown content coding: " + name);
+}
+
+bool supported(const Coding coding)
+{
+#ifndef GREYHOUND_BROTLI
+    if (coding == Coding::Brotli) return false;
+#endif
+    return true;
+}
+
+namespace
+{
+
+// Quality of each coding listed in an Accept-Encoding header.
+std::map<std::string, double> qualities(const std::string& acceptEncoding)
+{
+    std::map<std::string, double> qualities;
+
+    std::size_t pos(0);
+    while (pos <= acceptEncoding.size())
+    {
+        std::size_t end(acceptEncoding.find(',', pos));
+        if (end == std::string::npos) end = acceptEncoding.size();
+
+        const std::string item(acceptEncoding.substr(pos, end - pos));
+        pos = end + 1;
+
+        const std::size_t semi(item.find(';'));
+        std::string token(lower(trim(item.substr(0, semi))));
+        if (token.empty()) continue;
+        if (token == "x-gzip") token = "gzip";
+
+        double q(1);
+        if (semi != std::string::npos)
+        {
+            const std::string param(lower(trim(item.substr(semi + 1))));
+            if (param.compare(0, 2, "q=") == 0)
+            {
+                try { q = std::stod(param.substr(2)); }
+                catch (...) { q = 0; }
+            }
+        }
+
+        qualities[token] = q;
+    }
+
+    return qualities;
+}
+
+// A wildcard applies to codings that are not listed.  Anything not covered
+// by either is unacceptable.
+double quality(
+        const std::map<std::string, double>& qualities,
+        const std::string& token)
+{
+    auto it(qualities.find(token));
+    if (it == qualities.end()) it = qualities.find("*");
+    return it != qualities.end() ? it->second : 0;
+}
+
+} // unnamed namespace
+
+Coding negotiate(
+        const std::string& acceptEncoding,
+        const std::vector<Coding>& preferred)
+{
+    const auto q(qualities(acceptEncoding));
+
+    Coding best(Coding::Identity);
+    double bestQuality(0);
+
+    for (const Coding c : preferred)
+    {
+        const double cq(quality(q, name(c)));
+        if (cq > bestQuality)
+        {
+            best = c;
+            bestQuality = cq;
+        }
+    }
+
+    return best;
+}
+
+bool accepts(const std::string& acceptEncoding, const std::string& token)
+{
+    return quality(qualities(acceptEncoding), token) > 0;
+}
+
+bool matches(const std::string& ifNoneMatch, const std::string& etag)
+{
+    std::size_t pos(0);
+    while (pos <= ifNoneMatch.size())
+    {
+        const std::size_t end(
+                std::min(ifNoneMatch.find(',', pos), ifNoneMatch.size()));
+        std::string tag(trim(ifNoneMatch.substr(pos, end - pos)));
+        if (tag.compare(0, 2, "W/") == 0) tag = tag.substr(2);
+        if (tag == "*" || tag == etag) return true;
+        pos = end + 1;
+    }
+    return false;
+}
+
+Data encode(const Data& data, const Coding coding)
+{
+    switch (coding)
+    {
+        case Coding::Gzip:
+            return gzip(data);
+#ifdef GREYHOUND_BROTLI
+        case Coding::Brotli:
+            return brotli(data);
+#endif
+        case Coding::Identity:
+            return data;
+        default:
+            throw std::runtime_error("Unsupported content coding");
+    }
+}
+
+} // namespace encoding
+} // namespace greyhound
+
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+
+#include <greyhound/defs.hpp>
+
+namespace greyhound
+{
+namespace encoding
+{
+
+// Compact binary form of a hierarchy document.  Nodes are written in
+// breadth-first order, starting from the root, each as its point count in
+// unsigned LEB128 followed by a single byte whose bit i is set if the node
+// has a child in direction i of:
+//
+//      swd, sed, nwd, ned, swu, seu, nwu, neu
+//
+// Quadtree directions sw, se, nw, and ne share bits 0-3 with their "down"
+// counterparts.  Children always follow in the order of their bits, so node
+// keys are implied by position rather than being stored.
+Data hierarchy(const Json::Value& json);
+
+// 64-bit FNV-1a, which may be chained by passing a previous result as the
+// seed.  This is not cryptographic - it is used for cache validators.
+const uint64_t hashSeed(0xcbf29ce484222325ull);
+uint64_t hash(const char* data, std::size_t size, uint64_t seed = hashSeed);
+uint64_t hash(const std::string& s, uint64_t seed = hashSeed);
+
+// The zlib format, which is what HTTP calls "deflate".
+Data deflate(const Data& data);
+
+// Content codings negotiated through Accept-Encoding, as opposed to the
+// "deflate" selected explicitly by a `compress` query option.
+enum class Coding { Identity, Gzip, Brotli };
+
+// Token for a coding, as used in Accept-Encoding and Content-Encoding.  The
+// identity coding is an empty string.
+std::string name(Coding coding);
+
+// Throws for unknown names or codings that were not built in.
+Coding coding(const std::string& name);
+
+// False for Brotli if greyhound was built without it.
+bool supported(Coding coding);
+
+// The first of `preferred` that is acceptable according to the value of an
+// Accept-Encoding header, honoring q-values and wildcards.  Identity if
+// none of them are.
+Coding negotiate(
+        const std::string& acceptEncoding,
+        const std::vector<Coding>& preferred);
+
+// Whether the coding with the given token is acceptable according to the
+// value of an Accept-Encoding header.
+bool accepts(const std::string& acceptEncoding, const std::string& token);
+
+// Whether an If-None-Match header value lists the given entity tag.  This
+// uses weak comparison, as that header requires.
+bool matches(const std::string& ifNoneMatch, const std::string& etag);
+
+// Compress a payload in the given coding, feeding it to the encoder in
+// blocks so the output buffer grows with the compressed size.
+Data encode(const Data& data, Coding coding);
+
+} // namespace encoding
+} // namespace greyhound
+
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#include <sys/socket.h>
+
+#include <greyhound/defs.hpp>
+
+namespace greyhound
+{
+
+// A SimpleWeb server which may share its port with other listeners via
+// SO_REUSEPORT, so that the kernel balances incoming connections across
+// several acceptors, each with its own event loop.  Without reusePort this
+// is the plain server.
+template<typename S>
+class Listener : public S
+{
+public:
+    template<typename... Args>
+    explicit Listener(bool reusePort, Args&&... args)
+        : S(std::forward<Args>(args)...)
+        , m_reusePort(reusePort)
+    { }
+
+    static bool reusePortSupported()
+    {
+#ifdef SO_REUSEPORT
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Mirrors SimpleWeb's own start, with the additional socket option set
+    // before binding.
+    void start() override
+    {
+        if (!m_reusePort) return S::start();
+
+#ifdef SO_REUSEPORT
+        using ReusePort = SimpleWeb::asio::detail::socket_option::boolean<
+            SOL_SOCKET, SO_REUSEPORT>;
+        namespace asio = SimpleWeb::asio;
+
+        if (!this->io_service)
+        {
+            this->io_service = std::make_shared<asio::io_service>();
+            this->internal_io_service = true;
+        }
+
+        if (this->io_service->stopped()) this->io_service->reset();
+
+        asio::ip::tcp::endpoint endpoint;
+        if (this->config.address.size())
+        {
+            endpoint = asio::ip::tcp::endpoint(
+                    asio::ip::address::from_string(this->config.address),
+                    this->config.port);
+        }
+        else
+        {
+            endpoint = asio::ip::tcp::endpoint(
+                    asio::ip::tcp::v4(),
+                    this->config.port);
+        }
+
+        this->acceptor.reset(new asio::ip::tcp::acceptor(*this->io_service));
+        this->acceptor->open(endpoint.protocol());
+        this->acceptor->set_option(
+                asio::socket_base::reuse_address(this->config.reuse_address));
+        this->acceptor->set_option(ReusePort(true));
+        this->acceptor->bind(endpoint);
+        this->acceptor->listen();
+
+        this->accept();
+
+        if (!this->internal_io_service) return;
+
+        this->threads.clear();
+        for (std::size_t i(1); i < this->config.thread_pool_size; ++i)
+        {
+            this->threads.emplace_back([this]() { this->io_service->run(); });
+        }
+
+        if (this->config.thread_pool_size > 0) this->io_service->run();
+        for (auto& t : this->threads) t.join();
+#else
+        throw std::runtime_error("SO_REUSEPORT is not supported");
+#endif
+    }
+
+private:
+    const bool m_reusePort;
+};
+
+} // namespace greyhound
+
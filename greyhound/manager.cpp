@@ -2,10 +2,16 @@
 
 #include <algorithm>
 #include <cctype>
+#include <cmath>
+#include <fstream>
 #include <thread>
 
+#include <unistd.h>
+
 #include <entwine/reader/reader.hpp>
+#include <entwine/third/arbiter/arbiter.hpp>
 #include <entwine/util/json.hpp>
+#include <entwine/util/unique.hpp>
 
 namespace greyhound
 {
@@ -34,6 +40,50 @@ namespace
         return n * m;
     }
 
+    std::size_t getBytes(const Json::Value& json)
+    {
+        return json.isString() ?
+            parseBytes(json.asString()) :
+            json.asUInt64();
+    }
+
+    // The response cache is carved out of the overall cacheSize budget.
+    std::size_t responseCacheBytes(const Configuration& config)
+    {
+        const std::size_t total(getBytes(config["cacheSize"]));
+
+        if (!config.json().isMember("responseCacheSize")) return total / 10;
+
+        const std::size_t bytes(getBytes(config["responseCacheSize"]));
+        if (bytes > total)
+        {
+            throw std::runtime_error(
+                    "responseCacheSize may not be larger than cacheSize");
+        }
+        return bytes;
+    }
+
+    // Remote storage types whose files may be kept in the disk cache.
+    const std::vector<std::string> remoteTypes {
+        "s3", "gs", "az", "dropbox", "http", "https"
+    };
+
+    // Seconds between passes of the reader sweep.
+    const std::size_t sweepSeconds(10);
+
+    // Resources used this recently are likely to be in use, so they are not
+    // closed to satisfy maxReaders or memoryLimit.
+    const std::size_t busySeconds(5);
+
+    // Resident set size of this process, or zero if it is unavailable.
+    std::size_t residentBytes()
+    {
+        std::ifstream statm("/proc/self/statm");
+        std::size_t total(0), resident(0);
+        if (!(statm >> total >> resident)) return 0;
+        return resident * ::sysconf(_SC_PAGESIZE);
+    }
+
     std::string dense(const Json::Value& json)
     {
         auto s = Json::FastWriter().write(json);
@@ -43,15 +93,65 @@ namespace
 }
 
 Manager::Manager(const Configuration& config)
-    : m_cache(
-            config["cacheSize"].isString() ?
-                parseBytes(config["cacheSize"].asString()) :
-                config["cacheSize"].asUInt64())
+    : m_cache(getBytes(config["cacheSize"]) - responseCacheBytes(config))
+    , m_responseCache(responseCacheBytes(config))
+    , m_accessLog(config)
+    , m_admission(config)
+    , m_buffers(getBytes(config["bufferPoolSize"]))
     , m_paths(entwine::extract<std::string>(config["paths"]))
     , m_threads(std::max<std::size_t>(config["threads"].asUInt(), 4))
     , m_config(config)
+    , m_readers(std::make_shared<Readers>())
+    , m_resources(std::make_shared<Resources>())
+    , m_openSeconds(config["openTimeoutSeconds"].asUInt64())
+    , m_notFoundSeconds(config["notFoundTimeoutSeconds"].asUInt64())
+    , m_maxReaders(config["maxReaders"].asUInt64())
+    , m_memoryLimit(
+            config.json().isMember("memoryLimit") ?
+                getBytes(config["memoryLimit"]) : 0)
+    , m_openPool(m_threads, 1024)
+    , m_serverTiming(config["tracing"]["serverTiming"].asBool())
+    , m_compressMinBytes(
+            config["http"]["compression"]["minBytes"].asUInt64())
 {
     m_outerScope.getArbiter(config["arbiter"]);
+
+    if (config.json().isMember("diskCacheSize"))
+    {
+        const std::string dir(
+                config.json().isMember("diskCachePath") ?
+                    config["diskCachePath"].asString() :
+                    entwine::arbiter::util::join(
+                        config["tmp"].asString(),
+                        "greyhound-cache"));
+
+        m_diskCache = entwine::makeUnique<DiskCache>(
+                dir,
+                getBytes(config["diskCacheSize"]));
+
+        // Readers get an arbiter of their own whose remote drivers go
+        // through the disk cache, wrapping the drivers of the shared one.
+        m_arbiter = std::make_shared<entwine::arbiter::Arbiter>(
+                config["arbiter"]);
+
+        const auto& shared(*m_outerScope.getArbiter());
+        for (const auto& type : remoteTypes)
+        {
+            try
+            {
+                m_arbiter->addDriver(
+                        type,
+                        entwine::makeUnique<CachingDriver>(
+                            shared.getDriver(type + "://"),
+                            *m_diskCache));
+            }
+            catch (...)
+            {
+                // This type is not available in this build.
+            }
+        }
+    }
+
     m_auth = Auth::maybeCreate(config, *m_outerScope.getArbiter());
 
     for (const auto key : config["http"]["headers"].getMemberNames())
@@ -63,14 +163,57 @@ Manager::Manager(const Configuration& config)
     m_headers.emplace("X-powered-by", "Hobu, Inc.");
     m_headers.emplace("Access-Control-Allow-Headers", "Content-Type");
 
+    for (const auto& v : config["http"]["compression"]["codings"])
+    {
+        const std::string name(v.asString());
+        if (name == "br" && !encoding::supported(encoding::Coding::Brotli))
+        {
+            std::cout << "Brotli is not available in this build" << std::endl;
+        }
+        else m_codings.push_back(encoding::coding(name));
+    }
+
+    // Allow cross-origin clients to read the Server-Timing breakdown.
+    if (m_serverTiming) m_headers.emplace("Timing-Allow-Origin", "*");
+
     m_timeoutSeconds = std::max<double>(
             60.0 * config["resourceTimeoutMinutes"].asDouble(), 15);
 
     std::cout << "Settings:" << std::endl;
     std::cout << "\tCache: " << m_cache.maxBytes() << " bytes" << std::endl;
+    std::cout << "\tResponse cache: " << m_responseCache.maxBytes() <<
+        " bytes" << std::endl;
+    std::cout << "\tBuffer pool: " << m_buffers.maxBytes() << " bytes" <<
+        std::endl;
     std::cout << "\tThreads: " << m_threads << std::endl;
     std::cout << "\tResource timeout: " <<
         (m_timeoutSeconds / 60.0)  << " minutes" << std::endl;
+    if (m_maxReaders)
+    {
+        std::cout << "\tMax readers: " << m_maxReaders << std::endl;
+    }
+    if (m_memoryLimit)
+    {
+        std::cout << "\tMemory limit: " << m_memoryLimit << " bytes" <<
+            std::endl;
+    }
+    std::cout << "\tOpen timeout: " << m_openSeconds << "s" << std::endl;
+    std::cout << "\tNot found timeout: " << m_notFoundSeconds << "s" <<
+        std::endl;
+    if (m_codings.size())
+    {
+        std::cout << "\tCompression:";
+        for (const auto c : m_codings) std::cout << " " << encoding::name(c);
+        std::cout << " (from " << m_compressMinBytes << " bytes)" <<
+            std::endl;
+    }
+    if (m_diskCache)
+    {
+        std::cout << "\tDisk cache: " << m_diskCache->maxBytes() <<
+            " bytes in " << m_diskCache->dir() << " (" <<
+            m_diskCache->size() << " entries, " << m_diskCache->bytes() <<
+            " bytes)" << std::endl;
+    }
     std::cout << "\tTmp dir: " << m_config["tmp"].asString() << std::endl;
     std::cout << "Paths:" << std::endl;
     for (const auto p : m_paths) std::cout << "\t" << p << std::endl;
@@ -114,51 +257,414 @@ Manager::Manager(const Configuration& config)
             std::endl;
         std::cout << "\tFailure timeout: " << m_auth->badSeconds() << "s" <<
             std::endl;
+        std::cout << "\tStale grace: " << m_auth->staleSeconds() << "s" <<
+            std::endl;
+        std::cout << "\tMax entries: " << m_auth->maxEntries() << std::endl;
     }
 
+    m_metrics.gauge(
+            this,
+            "greyhound_cache_max_bytes",
+            "Configured capacity of the chunk cache.",
+            "",
+            [this]() { return m_cache.maxBytes(); });
+
+    if (m_diskCache)
+    {
+        m_metrics.gauge(
+                this,
+                "greyhound_disk_cache_bytes",
+                "Bytes held by the disk cache.",
+                "",
+                [this]() { return m_diskCache->bytes(); });
+
+        m_metrics.gauge(
+                this,
+                "greyhound_disk_cache_entries",
+                "Files held by the disk cache.",
+                "",
+                [this]() { return m_diskCache->size(); });
+
+        m_metrics.counter(
+                this,
+                "greyhound_disk_cache_hits_total",
+                "Remote files read from the disk cache since startup.",
+                "",
+                [this]() { return m_diskCache->hits(); });
+
+        m_metrics.counter(
+                this,
+                "greyhound_disk_cache_misses_total",
+                "Remote files not found in the disk cache since startup.",
+                "",
+                [this]() { return m_diskCache->misses(); });
+    }
+
+    m_metrics.gauge(
+            this,
+            "greyhound_response_cache_bytes",
+            "Bytes held by the response cache.",
+            "",
+            [this]() { return m_responseCache.bytes(); });
+
+    m_metrics.gauge(
+            this,
+            "greyhound_response_cache_max_bytes",
+            "Configured capacity of the response cache.",
+            "",
+            [this]() { return m_responseCache.maxBytes(); });
+
+    m_metrics.gauge(
+            this,
+            "greyhound_response_cache_entries",
+            "Entries held by the response cache.",
+            "",
+            [this]() { return m_responseCache.size(); });
+
+    m_metrics.gauge(
+            this,
+            "greyhound_inflight_reads",
+            "Distinct read queries currently running.",
+            "",
+            [this]() { return m_flights.size(); });
+
+    m_metrics.counter(
+            this,
+            "greyhound_buffer_pool_hits_total",
+            "Buffers acquired from the buffer pool.",
+            "",
+            [this]() { return m_buffers.hits(); });
+
+    m_metrics.counter(
+            this,
+            "greyhound_buffer_pool_misses_total",
+            "Buffers allocated because none were pooled.",
+            "",
+            [this]() { return m_buffers.misses(); });
+
+    m_metrics.gauge(
+            this,
+            "greyhound_buffer_pool_retained_bytes",
+            "Capacity of idle buffers held for reuse.",
+            "",
+            [this]() { return m_buffers.retainedBytes(); });
+
+    m_metrics.gauge(
+            this,
+            "greyhound_readers",
+            "Known resources.",
+            "",
+            [this]() { return readers()->size(); });
+
+    m_metrics.gauge(
+            this,
+            "greyhound_readers_live",
+            "Resources with an open reader.",
+            "",
+            [this]()
+            {
+                const auto snapshot(readers());
+                return std::count_if(
+                        snapshot->begin(),
+                        snapshot->end(),
+                        [](const Readers::value_type& p)
+                        {
+                            return p.second->exists();
+                        });
+            });
+
+    m_metrics.gauge(
+            this,
+            "greyhound_resident_bytes",
+            "Resident memory of the server process.",
+            "",
+            []() { return residentBytes(); });
+
+    m_metrics.gauge(
+            this,
+            "greyhound_ready",
+            "Whether configured resources have been pre-warmed.",
+            "",
+            [this]() { return m_ready ? 1 : 0; });
+
+    m_metrics.gauge(
+            this,
+            "greyhound_access_log_dropped",
+            "Access log entries dropped due to full buffers.",
+            "",
+            [this]() { return m_accessLog.dropped(); });
+
     m_lastSweep = getNow();
 
     auto loop([this]()
     {
-        std::unique_lock<std::mutex> lock(m_mutex);
+        std::unique_lock<std::mutex> lock(m_sweepMutex);
         while (!m_done)
         {
-            m_cv.wait_for(lock, std::chrono::seconds(60), [this]()
+            m_cv.wait_for(lock, std::chrono::seconds(sweepSeconds), [this]()
             {
-                return m_done || secondsSince(m_lastSweep) >= 60;
+                return m_done || secondsSince(m_lastSweep) >= sweepSeconds;
             });
             sweep();
         }
     });
 
     m_sweepThread = std::thread(loop);
+
+    if (config["prewarm"].size())
+    {
+        std::cout << "Prewarming:" << std::endl;
+        for (const auto& entry : config["prewarm"])
+        {
+            std::cout << "\t" <<
+                (entry.isObject() ? dense(entry) : entry.asString()) <<
+                std::endl;
+        }
+
+        m_prewarmThread = std::thread([this]() { prewarm(); });
+    }
+    else m_ready = true;
 }
 
 Manager::~Manager()
 {
     {
-        std::lock_guard<std::mutex> lock(m_mutex);
+        std::lock_guard<std::mutex> lock(m_sweepMutex);
         m_done = true;
     }
     m_cv.notify_all();
     m_sweepThread.join();
+    if (m_prewarmThread.joinable()) m_prewarmThread.join();
+}
+
+void Manager::prewarm()
+{
+    const auto start(getNow());
+    const Json::Value& list(m_config["prewarm"]);
+
+    std::mutex mutex;
+    entwine::Pool pool(m_threads, list.size());
+
+    for (const Json::Value& entry : list)
+    {
+        pool.add([this, &entry, &mutex]()
+        {
+            const std::string name(entry.isObject() ?
+                    entry["resource"].asString() : entry.asString());
+
+            try
+            {
+                // Aliases are resolved as usual, so each underlying reader
+                // is opened and warmed.
+                SharedResource resource(create(name));
+
+                // Fetching a query's chunks populates the cache, but we
+                // only need to transfer a single dimension to do so.
+                Json::Value q;
+                for (const auto key : { "depthBegin", "depthEnd", "bounds" })
+                {
+                    if (entry.isObject() && entry.isMember(key))
+                    {
+                        q[key] = entry[key];
+                    }
+                }
+
+                if (!q.isNull())
+                {
+                    Json::Value dim;
+                    dim["name"] = "X";
+                    dim["type"] = "floating";
+                    dim["size"] = 8;
+                    q["schema"].append(dim);
+                }
+
+                for (TimedReader* tr : resource->readers())
+                {
+                    SharedReader reader(tr->get());
+                    if (!q.isNull()) reader->getQuery(q)->run();
+                }
+
+                resource->cachedInfo();
+            }
+            catch (const std::exception& e)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                std::cout << "Prewarm failed for " << name << ": " <<
+                    e.what() << std::endl;
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                std::cout << "Prewarm failed for " << name << ": " <<
+                    "unknown error" << std::endl;
+            }
+        });
+    }
+
+    pool.join();
+
+    m_ready = true;
+    std::cout << "Prewarm complete in " << secondsSince(start) << "s" <<
+        std::endl;
+}
+
+void Manager::invalidate(const std::string& readerName) const
+{
+    for (const auto& p : *resources())
+    {
+        const auto names(p.second->sources());
+        if (std::count(names.begin(), names.end(), readerName))
+        {
+            p.second->invalidate();
+        }
+    }
+
+    m_responseCache.invalidate(readerName);
+}
+
+SharedResource Manager::create(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Another thread may have published this resource since our lookup.
+    auto it(m_resources->find(name));
+    if (it != m_resources->end()) return it->second;
+
+    std::shared_ptr<Readers> nextReaders;
+    std::vector<TimedReader*> list;
+
+    for (const auto s : resolve(name))
+    {
+        auto rit(m_readers->find(s));
+        if (rit != m_readers->end())
+        {
+            list.push_back(rit->second.get());
+        }
+        else
+        {
+            if (!nextReaders)
+            {
+                nextReaders = std::make_shared<Readers>(*m_readers);
+            }
+
+            auto reader(std::make_shared<TimedReader>(*this, s));
+            nextReaders->emplace(s, reader);
+            list.push_back(reader.get());
+        }
+    }
+
+    auto resource(std::make_shared<Resource>(*this, name, list));
+
+    auto nextResources(std::make_shared<Resources>(*m_resources));
+    nextResources->emplace(name, resource);
+
+    if (nextReaders)
+    {
+        std::atomic_store(
+                &m_readers,
+                std::shared_ptr<const Readers>(std::move(nextReaders)));
+    }
+
+    std::atomic_store(
+            &m_resources,
+            std::shared_ptr<const Resources>(std::move(nextResources)));
+
+    return resource;
+}
+
+bool Manager::evict(TimedReader& tr, const std::string& reason)
+{
+    // A reader that is busy being opened is not a sweep candidate, and
+    // waiting on it would only delay the rest of the pass.
+    std::unique_lock<std::mutex> lock(tr.mutex(), std::try_to_lock);
+    if (!lock || !tr.exists()) return false;
+
+    std::cout << "Sweeping " + tr.name() + " (" + reason + ")" << std::endl;
+    tr.reset();
+    m_metrics.evicted(reason);
+    return true;
 }
 
 void Manager::sweep()
 {
     m_lastSweep = getNow();
-    for (auto it(m_readers.begin()); it != m_readers.end(); ++it)
+
+    struct Candidate
+    {
+        TimedReader* reader;
+        double score;
+    };
+
+    std::vector<Candidate> live;
+    std::size_t open(0);
+    std::size_t chunkBytes(0);
+
+    for (const auto& p : *readers())
     {
-        TimedReader& tr(it->second);
-        std::lock_guard<std::mutex> lock(tr.mutex());
-        if (tr.exists() && tr.since() > m_timeoutSeconds)
+        TimedReader& tr(*p.second);
+        if (!tr.exists()) continue;
+
+        const std::size_t since(tr.since());
+
+        if (since > m_timeoutSeconds && evict(tr, "idle")) continue;
+
+        ++open;
+        chunkBytes += tr.bytes();
+        if (since >= busySeconds)
         {
-            std::cout << "Sweeping " << tr.name() << "..." << std::flush;
-            tr.reset();
-            std::cout << " done" << std::endl;
-            return;
+            // Prefer evicting readers that have been idle the longest,
+            // weighted toward those with the largest footprint.
+            const double score(since * std::log2(2.0 + tr.points()));
+            live.push_back(Candidate { &tr, score });
         }
     }
+
+    std::sort(
+            live.begin(),
+            live.end(),
+            [](const Candidate& a, const Candidate& b)
+            {
+                return a.score > b.score;
+            });
+
+    auto it(live.begin());
+
+    while (m_maxReaders && it != live.end() && open > m_maxReaders)
+    {
+        TimedReader& tr(*(it++)->reader);
+        const std::size_t bytes(tr.bytes());
+        if (evict(tr, "count"))
+        {
+            --open;
+            chunkBytes -= bytes;
+        }
+    }
+
+    // Freed heap is often not returned to the system, so the resident size
+    // may stay high long after memory is released.  Evictions are therefore
+    // driven by an estimate of what we have allocated, where the chunks held
+    // for each reader are bounded by both its size and the chunk cache's.
+    // The resident size only serves as a guard, so that nothing is closed
+    // while the process is actually within its limit.
+    if (!m_memoryLimit) return;
+
+    auto estimate([this, &chunkBytes]()
+    {
+        return std::min(chunkBytes, m_cache.maxBytes()) +
+            m_responseCache.bytes() + m_buffers.retainedBytes();
+    });
+
+    if (estimate() <= m_memoryLimit || residentBytes() <= m_memoryLimit)
+    {
+        return;
+    }
+
+    while (it != live.end() && estimate() > m_memoryLimit)
+    {
+        TimedReader& tr(*(it++)->reader);
+        const std::size_t bytes(tr.bytes());
+        if (bytes && evict(tr, "memory")) chunkBytes -= bytes;
+    }
 }
 
 } // namespace greyhound
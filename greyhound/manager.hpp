@@ -1,18 +1,30 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <exception>
 #include <map>
 #include <mutex>
 #include <string>
+#include <vector>
 
 #include <entwine/reader/cache.hpp>
 #include <entwine/types/outer-scope.hpp>
 
+#include <greyhound/access-log.hpp>
+#include <greyhound/admission.hpp>
 #include <greyhound/auth.hpp>
+#include <greyhound/buffer-pool.hpp>
 #include <greyhound/configuration.hpp>
 #include <greyhound/defs.hpp>
+#include <greyhound/disk-cache.hpp>
+#include <greyhound/encoding.hpp>
+#include <greyhound/metrics.hpp>
 #include <greyhound/resource.hpp>
+#include <greyhound/response-cache.hpp>
+#include <greyhound/single-flight.hpp>
+#include <greyhound/trace.hpp>
 
 namespace greyhound
 {
@@ -27,13 +39,78 @@ public:
     SharedResource get(std::string name, Req& req);
 
     entwine::Cache& cache() const { return m_cache; }
+    ResponseCache& responseCache() const { return m_responseCache; }
+    SingleFlight& flights() const { return m_flights; }
+    AccessLog& accessLog() const { return m_accessLog; }
+    Admission& admission() const { return m_admission; }
+    BufferPool& buffers() const { return m_buffers; }
+    Metrics& metrics() const { return m_metrics; }
+
+    // Record a completed request to the metrics and the access log, along
+    // with the trace of the request being handled, if any.
+    void record(AccessLog::Entry entry) const
+    {
+        if (!entry.trace) entry.trace = Trace::shared();
+        m_metrics.record(entry);
+        m_accessLog.push(std::move(entry));
+    }
+
+    // Discard cached info and responses for every resource that includes the
+    // given reader, after its data or addon set has changed.
+    void invalidate(const std::string& readerName) const;
+
     entwine::OuterScope& outerScope() const { return m_outerScope; }
+
+    // The arbiter through which readers fetch their data, which goes
+    // through the disk cache if one is configured.
+    entwine::arbiter::Arbiter& arbiter() const
+    {
+        return m_arbiter ? *m_arbiter : *m_outerScope.getArbiter();
+    }
     const Paths& paths() const { return m_paths; }
-    const Headers& headers() const { return m_headers; }
+
+    // Headers for every response.  While a traced request is being handled
+    // this includes its Server-Timing so far, which may be brought up to
+    // date by Trace::stamp just before the headers are written.
+    Headers headers() const
+    {
+        Headers h(m_headers);
+        if (m_serverTiming)
+        {
+            if (const Trace* trace = Trace::current())
+            {
+                h.emplace("Server-Timing", trace->serverTiming());
+            }
+        }
+        return h;
+    }
+
+    // True if requests should be traced, for either Server-Timing headers
+    // or an OTLP access log.
+    bool tracing() const { return m_serverTiming || m_accessLog.traced(); }
     std::size_t threads() const { return m_threads; }
 
+    // Content coding for a compressible response to a client sending the
+    // given Accept-Encoding, in the configured order of preference.
+    // Payloads smaller than compressMinBytes() are always sent as they are.
+    encoding::Coding coding(const std::string& acceptEncoding) const
+    {
+        return encoding::negotiate(acceptEncoding, m_codings);
+    }
+    std::size_t compressMinBytes() const { return m_compressMinBytes; }
+    const std::vector<encoding::Coding>& codings() const { return m_codings; }
+
+    // Readers are opened in the background on this pool.
+    entwine::Pool& openPool() const { return m_openPool; }
+    std::size_t openSeconds() const { return m_openSeconds; }
+    std::size_t notFoundSeconds() const { return m_notFoundSeconds; }
+
     const Configuration& config() const { return m_config; }
 
+    // False until all resources listed in the prewarm configuration have
+    // been opened and had their requested chunks fetched into the cache.
+    bool ready() const { return m_ready; }
+
 private:
     std::vector<std::string> resolve(std::string name) const
     {
@@ -41,11 +118,26 @@ private:
         else return std::vector<std::string>{ name };
     }
 
+    // Close idle readers, and then the least valuable open readers until
+    // we are within the configured reader count and memory limits.
     void sweep();
+    void prewarm();
+    bool evict(TimedReader& reader, const std::string& reason);
 
     mutable entwine::Cache m_cache;
+    mutable ResponseCache m_responseCache;
+    mutable SingleFlight m_flights;
+    mutable AccessLog m_accessLog;
+    mutable Admission m_admission;
+    mutable BufferPool m_buffers;
+    mutable Metrics m_metrics;
     mutable entwine::OuterScope m_outerScope;
 
+    // Declared after the outer scope, whose drivers these wrap, and before
+    // the readers which use them.
+    std::unique_ptr<DiskCache> m_diskCache;
+    std::shared_ptr<entwine::arbiter::Arbiter> m_arbiter;
+
     Paths m_paths;
     Headers m_headers;
     const std::size_t m_threads;
@@ -53,79 +145,119 @@ private:
     const Configuration& m_config;
     std::map<std::string, std::vector<std::string>> m_aliases;
 
-    std::map<std::string, TimedReader> m_readers;
-    std::map<std::string, SharedResource> m_resources;
+    // Lookups are served lock-free from immutable snapshots, which are
+    // replaced wholesale under m_mutex whenever a new entry is added.  Entries
+    // are never removed, so pointers to a TimedReader remain valid for the
+    // lifetime of the Manager.
+    using Readers = std::map<std::string, std::shared_ptr<TimedReader>>;
+    using Resources = std::map<std::string, SharedResource>;
+
+    std::shared_ptr<const Readers> readers() const
+    {
+        return std::atomic_load(&m_readers);
+    }
+
+    std::shared_ptr<const Resources> resources() const
+    {
+        return std::atomic_load(&m_resources);
+    }
+
+    SharedResource create(const std::string& name);
+
+    std::shared_ptr<const Readers> m_readers;
+    std::shared_ptr<const Resources> m_resources;
     std::unique_ptr<Auth> m_auth;
 
+    const std::size_t m_openSeconds;
+    const std::size_t m_notFoundSeconds;
+    const std::size_t m_maxReaders;
+    const std::size_t m_memoryLimit;
+
+    // Declared after the readers, so that pending opens are finished before
+    // the readers they refer to are destroyed.
+    mutable entwine::Pool m_openPool;
+
     mutable std::mutex m_mutex;
+    mutable std::mutex m_sweepMutex;
 
     bool m_done = false;
     std::size_t m_timeoutSeconds = 0;
     TimePoint m_lastSweep;
     mutable std::condition_variable m_cv;
     std::thread m_sweepThread;
+
+    std::atomic<bool> m_ready{false};
+    std::thread m_prewarmThread;
+
+    bool m_serverTiming;
+
+    std::vector<encoding::Coding> m_codings;
+    const std::size_t m_compressMinBytes;
 };
 
 template<typename Req>
 SharedResource Manager::get(std::string name, Req& req)
 {
-    std::unique_lock<std::mutex> lock(m_mutex);
+    const auto snapshot(resources());
+    auto it(snapshot->find(name));
+
+    SharedResource resource(
+            it != snapshot->end() ? it->second : create(name));
+
+    auto& readers(resource->readers());
 
-    auto it(m_resources.find(name));
-    if (it == m_resources.end())
+    if (m_auth)
     {
-        std::vector<TimedReader*> readers;
+        Trace::Scope scope("auth");
 
-        for (const auto s : resolve(name))
-        {
-            auto rit(m_readers.find(s));
-            if (rit == m_readers.end())
-            {
-                rit = m_readers.emplace(
-                        std::piecewise_construct,
-                        std::forward_as_tuple(s),
-                        std::forward_as_tuple(*this, s)).first;
-            }
+        std::vector<std::string> names;
+        for (TimedReader* reader : readers) names.push_back(reader->name());
 
-            readers.push_back(&rit->second);
+        const auto result(m_auth->check(names, req));
+        if (!ok(result.second))
+        {
+            throw HttpError(
+                    result.second,
+                    "Authorization failure: " + result.first);
         }
-
-        it = m_resources.emplace(
-                name,
-                std::make_shared<Resource>(*this, name, readers)).first;
     }
 
-    SharedResource resource(it->second);
+    Trace::Scope scope("open");
+
+    if (readers.size() == 1)
+    {
+        readers.front()->get();
+        return resource;
+    }
 
-    lock.unlock();
+    // Wait for all of the underlying readers to be opened concurrently.
+    // Failures are not propagated out of the pool, so capture the first one
+    // to be rethrown here.
+    std::exception_ptr error;
+    std::mutex errorMutex;
 
-    entwine::Pool pool(threads());
+    entwine::Pool pool(std::min(threads(), readers.size()), readers.size());
 
-    for (TimedReader* reader : resource->readers())
+    for (TimedReader* reader : readers)
     {
-        const auto name(reader->name());
-        if (m_auth)
+        pool.add([reader, &error, &errorMutex]()
         {
-            const auto code(m_auth->check(name, req));
-            if (!ok(code))
+            try
             {
-                throw HttpError(code, "Authorization failure: " + name);
+                reader->get();
             }
-        }
-
-        pool.add([reader, name]()
-        {
-            if (!reader->get())
+            catch (...)
             {
-                throw HttpError(
-                        HttpStatusCode::client_error_not_found,
-                        "Not found: " + name);
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error) error = std::current_exception();
             }
         });
     }
 
     pool.join();
 
+    if (error) std::rethrow_exception(error);
+
     return resource;
 }
 
@@ -0,0 +1,245 @@
+#include <greyhound/metrics.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <sstream>
+
+namespace greyhound
+{
+
+namespace
+{
+
+std::string escape(const std::string& s)
+{
+    std::string out;
+    for (const char c : s)
+    {
+        if (c == '\\' || c == '"') out.push_back('\\');
+        if (c == '\n') out += "\\n";
+        else out.push_back(c);
+    }
+    return out;
+}
+
+void header(
+        std::ostream& os,
+        const std::string& name,
+        const std::string& help,
+        const std::string& type)
+{
+    os << "# HELP " << name << " " << help << "\n";
+    os << "# TYPE " << name << " " << type << "\n";
+}
+
+// Whole values, such as byte counts, are written exactly, rather than in
+// the stream's default six significant digits.
+std::string number(const double v)
+{
+    std::ostringstream ss;
+    if (v == std::floor(v) && std::abs(v) < 9e18) ss << static_cast<int64_t>(v);
+    else ss << std::setprecision(17) << v;
+    return ss.str();
+}
+
+} // unnamed namespace
+
+const std::vector<double>& Metrics::buckets()
+{
+    static const std::vector<double> b {
+        0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10
+    };
+    return b;
+}
+
+void Metrics::record(const AccessLog::Entry& entry)
+{
+    Series& s(series(entry.endpoint, entry.resource));
+
+    ++s.requests;
+    s.points += entry.points;
+    s.bytes += entry.bytes;
+    s.ms += entry.ms;
+    if (entry.canceled) ++s.canceled;
+    if (entry.cached) ++s.cached;
+
+    const double seconds(entry.ms / 1000.0);
+    const auto& b(buckets());
+    const auto it(std::lower_bound(b.begin(), b.end(), seconds));
+    if (it != b.end()) ++s.histogram[it - b.begin()];
+    else ++s.overflow;
+}
+
+void Metrics::error(const HttpStatusCode code)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_errors[static_cast<int>(code)];
+}
+
+void Metrics::evicted(const std::string& reason)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_evictions[reason];
+}
+
+void Metrics::gauge(
+        const void* owner,
+        const std::string& name,
+        const std::string& help,
+        const std::string& labels,
+        Gauge f)
+{
+    sample(GaugeInfo { owner, name, help, labels, f, "gauge" });
+}
+
+void Metrics::counter(
+        const void* owner,
+        const std::string& name,
+        const std::string& help,
+        const std::string& labels,
+        Gauge f)
+{
+    sample(GaugeInfo { owner, name, help, labels, f, "counter" });
+}
+
+void Metrics::sample(GaugeInfo info)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_gauges.push_back(std::move(info));
+}
+
+void Metrics::unregister(const void* owner)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_gauges.erase(
+            std::remove_if(
+                m_gauges.begin(),
+                m_gauges.end(),
+                [owner](const GaugeInfo& g) { return g.owner == owner; }),
+            m_gauges.end());
+}
+
+Metrics::Series& Metrics::series(
+        const std::string& endpoint,
+        const std::string& resource)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& s(m_series[std::make_pair(endpoint, resource)]);
+    if (!s) s.reset(new Series());
+    return *s;
+}
+
+std::string Metrics::text() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::ostringstream os;
+
+    auto labels([](const std::pair<std::string, std::string>& key)
+    {
+        return "endpoint=\"" + escape(key.first) + "\",resource=\"" +
+            escape(key.second) + "\"";
+    });
+
+    auto counter([&](
+                const std::string& name,
+                const std::string& help,
+                std::function<uint64_t(const Series&)> f)
+    {
+        header(os, name, help, "counter");
+        for (const auto& p : m_series)
+        {
+            os << name << "{" << labels(p.first) << "} " << f(*p.second) <<
+                "\n";
+        }
+    });
+
+    counter(
+            "greyhound_requests_total",
+            "Requests served.",
+            [](const Series& s) { return s.requests.load(); });
+    counter(
+            "greyhound_points_total",
+            "Points served.",
+            [](const Series& s) { return s.points.load(); });
+    counter(
+            "greyhound_bytes_total",
+            "Response body bytes served.",
+            [](const Series& s) { return s.bytes.load(); });
+    counter(
+            "greyhound_canceled_total",
+            "Requests canceled by the client before completion.",
+            [](const Series& s) { return s.canceled.load(); });
+    counter(
+            "greyhound_cached_total",
+            "Requests served from the response cache.",
+            [](const Series& s) { return s.cached.load(); });
+
+    const std::string duration("greyhound_request_duration_seconds");
+    header(os, duration, "Request latency.", "histogram");
+    for (const auto& p : m_series)
+    {
+        const Series& s(*p.second);
+        const std::string l(labels(p.first));
+        const auto& b(buckets());
+
+        uint64_t total(0);
+        for (std::size_t i(0); i < b.size(); ++i)
+        {
+            total += s.histogram[i];
+            os << duration << "_bucket{" << l << ",le=\"" << b[i] << "\"} " <<
+                total << "\n";
+        }
+
+        total += s.overflow;
+        os << duration << "_bucket{" << l << ",le=\"+Inf\"} " << total << "\n";
+        os << duration << "_sum{" << l << "} " << number(s.ms / 1000.0) <<
+            "\n";
+        os << duration << "_count{" << l << "} " << total << "\n";
+    }
+
+    header(os, "greyhound_errors_total", "Error responses.", "counter");
+    for (const auto& p : m_errors)
+    {
+        os << "greyhound_errors_total{code=\"" << p.first << "\"} " <<
+            p.second << "\n";
+    }
+
+    header(
+            os,
+            "greyhound_reader_evictions_total",
+            "Readers closed and released from the chunk cache.",
+            "counter");
+    for (const auto& p : m_evictions)
+    {
+        os << "greyhound_reader_evictions_total{reason=\"" <<
+            escape(p.first) << "\"} " << p.second << "\n";
+    }
+
+    // Samples for the same gauge or counter must be contiguous.
+    std::vector<GaugeInfo> gauges(m_gauges);
+    std::stable_sort(
+            gauges.begin(),
+            gauges.end(),
+            [](const GaugeInfo& a, const GaugeInfo& b)
+            {
+                return a.name < b.name;
+            });
+
+    std::string last;
+    for (const auto& g : gauges)
+    {
+        if (g.name != last) header(os, g.name, g.help, g.type);
+        last = g.name;
+
+        os << g.name;
+        if (g.labels.size()) os << "{" << g.labels << "}";
+        os << " " << number(g.f()) << "\n";
+    }
+
+    return os.str();
+}
+
+} // namespace greyhound
+
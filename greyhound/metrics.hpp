@@ -0,0 +1,106 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <greyhound/access-log.hpp>
+#include <greyhound/defs.hpp>
+
+namespace greyhound
+{
+
+// Request and server statistics, exposed in the Prometheus text format.
+class Metrics
+{
+public:
+    using Gauge = std::function<double()>;
+
+    // Record a completed request.
+    void record(const AccessLog::Entry& entry);
+
+    // Record a request that failed with an error response.
+    void error(HttpStatusCode code);
+
+    // Record the eviction of an open reader, and the release of its chunk
+    // cache residency, for the given reason.
+    void evicted(const std::string& reason);
+
+    // Register a gauge whose value is sampled at each scrape.  The labels
+    // string is in exposition format, for example: port="8080".  Gauges
+    // are removed by owner, so their owner must unregister them before any
+    // state captured by them is destroyed.
+    void gauge(
+            const void* owner,
+            const std::string& name,
+            const std::string& help,
+            const std::string& labels,
+            Gauge f);
+
+    // Like gauge, for a value that only increases, such as a count of
+    // events.  By convention its name should end in "_total".
+    void counter(
+            const void* owner,
+            const std::string& name,
+            const std::string& help,
+            const std::string& labels,
+            Gauge f);
+
+    void unregister(const void* owner);
+
+    std::string text() const;
+
+private:
+    // Latency bucket upper bounds, in seconds.
+    static const std::vector<double>& buckets();
+
+    struct Series
+    {
+        Series() : histogram(buckets().size()) { }
+
+        std::atomic<uint64_t> requests{0};
+        std::atomic<uint64_t> points{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> canceled{0};
+        std::atomic<uint64_t> cached{0};
+        std::atomic<uint64_t> ms{0};
+
+        // Non-cumulative count per bucket, where the final bucket is +Inf.
+        std::vector<std::atomic<uint64_t>> histogram;
+        std::atomic<uint64_t> overflow{0};
+    };
+
+    struct GaugeInfo
+    {
+        const void* owner;
+        std::string name;
+        std::string help;
+        std::string labels;
+        Gauge f;
+        std::string type;
+    };
+
+    void sample(GaugeInfo info);
+
+    Series& series(const std::string& endpoint, const std::string& resource);
+
+    // Keyed by (endpoint, resource).  Series are never removed, so we only
+    // need to lock to look them up - updates are atomic.
+    std::map<std::pair<std::string, std::string>, std::unique_ptr<Series>>
+        m_series;
+    std::map<int, uint64_t> m_errors;
+    std::map<std::string, uint64_t> m_evictions;
+    std::vector<GaugeInfo> m_gauges;
+
+    mutable std::mutex m_mutex;
+};
+
+} // namespace greyhound
+
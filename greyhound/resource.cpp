@@ -1,5 +1,17 @@
 #include <greyhound/resource.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <iomanip>
+#include <istream>
+#include <limits>
+#include <sstream>
+
 #include <json/json.h>
 
 #include <entwine/reader/reader.hpp>
@@ -9,11 +21,14 @@
 #include <entwine/types/reprojection.hpp>
 #include <entwine/types/schema.hpp>
 #include <entwine/types/structure.hpp>
-#include <entwine/util/compression.hpp>
+#include <entwine/util/pool.hpp>
 #include <entwine/util/unique.hpp>
 
 #include <greyhound/chunker.hpp>
+#include <greyhound/converter.hpp>
+#include <greyhound/encoding.hpp>
 #include <greyhound/manager.hpp>
+#include <greyhound/trace.hpp>
 
 namespace greyhound
 {
@@ -38,45 +53,375 @@ template<typename Req> Json::Value parseQuery(Req& req)
     return q;
 }
 
-enum class Color
+// Run `run` for each index in [0, n) on a pool of up to `threads` workers.
+// Each result is passed to `use` on the calling thread, in index order, as
+// soon as it and all of its predecessors are complete.  An index is only
+// started once the one a full pool's width before it has been used, so no
+// more than one result per worker is ever held.  If `use` returns false,
+// remaining results are discarded.  The first failure is rethrown on the
+// calling thread.
+template<typename T>
+void fanOut(
+        const std::size_t n,
+        const std::size_t threads,
+        const std::function<T(std::size_t)>& run,
+        const std::function<bool(std::size_t, T&)>& use)
+{
+    if (n == 1)
+    {
+        T result(run(0));
+        use(0, result);
+        return;
+    }
+
+    struct Slot
+    {
+        std::unique_ptr<T> result;
+        std::exception_ptr error;
+        bool done = false;
+    };
+
+    std::vector<Slot> slots(n);
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::atomic<bool> stop(false);
+
+    // At most `width` tasks are outstanding, so adding one never blocks.
+    const std::size_t width(std::max<std::size_t>(std::min(n, threads), 1));
+    entwine::Pool pool(width, width);
+
+    // Workers contribute to the caller's trace.
+    const std::shared_ptr<Trace> trace(Trace::shared());
+
+    auto begin([&](const std::size_t i)
+    {
+        pool.add([&, i]()
+        {
+            Trace::Bind bind(trace);
+            Slot& slot(slots[i]);
+
+            try
+            {
+                if (!stop) slot.result = entwine::makeUnique<T>(run(i));
+            }
+            catch (...)
+            {
+                slot.error = std::current_exception();
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            slot.done = true;
+            cv.notify_all();
+        });
+    });
+
+    for (std::size_t i(0); i < width; ++i) begin(i);
+
+    for (std::size_t i(0); i < n && !stop; ++i)
+    {
+        Slot& slot(slots[i]);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&slot]() { return slot.done; });
+        lock.unlock();
+
+        if (slot.error)
+        {
+            stop = true;
+            pool.join();
+            std::rethrow_exception(slot.error);
+        }
+
+        if (!use(i, *slot.result)) stop = true;
+        slot.result.reset();
+
+        if (!stop && i + width < n) begin(i + width);
+    }
+
+    pool.join();
+}
+
+// Identifies this process, for validators that are only meaningful within
+// its lifetime.
+const uint64_t bootId(std::chrono::system_clock::now().time_since_epoch()
+        .count());
+
+std::string trim(const std::string& s)
 {
-    Black,
-    Red,
-    Green,
-    Yellow,
-    Blue,
-    Magenta,
-    Cyan,
-    White
+    const auto b(s.find_first_not_of(" \t"));
+    if (b == std::string::npos) return "";
+    return s.substr(b, s.find_last_not_of(" \t") - b + 1);
+}
+
+template<typename Req>
+bool notModified(Req& req, const std::string& etag)
+{
+    const auto it(req.header.find("If-None-Match"));
+    return it != req.header.end() && encoding::matches(it->second, etag);
+}
+
+enum class Range { None, Satisfiable, Unsatisfiable };
+
+// Parse a single byte range of the form "bytes=a-b", "bytes=a-", or
+// "bytes=-n" into inclusive bounds.  Multiple ranges are not supported, so
+// like malformed ranges they are ignored in favor of the full response.
+Range parseRange(
+        const std::string& s,
+        const std::size_t size,
+        std::size_t& first,
+        std::size_t& last)
+{
+    const std::string prefix("bytes=");
+    if (s.compare(0, prefix.size(), prefix)) return Range::None;
+
+    const std::string spec(trim(s.substr(prefix.size())));
+    const std::size_t dash(spec.find('-'));
+    if (dash == std::string::npos || spec.find(',') != std::string::npos)
+    {
+        return Range::None;
+    }
+
+    const std::string a(spec.substr(0, dash));
+    const std::string b(spec.substr(dash + 1));
+    const auto digits([](const std::string& v)
+    {
+        return v.find_first_not_of("0123456789") == std::string::npos;
+    });
+
+    if (!digits(a) || !digits(b) || (a.empty() && b.empty()))
+    {
+        return Range::None;
+    }
+
+    if (a.empty())
+    {
+        const std::size_t n(std::stoull(b));
+        if (!n || !size) return Range::Unsatisfiable;
+        first = size - std::min(n, size);
+        last = size - 1;
+        return Range::Satisfiable;
+    }
+
+    first = std::stoull(a);
+    last = size - 1;
+    if (!b.empty()) last = std::min<std::size_t>(std::stoull(b), last);
+
+    if (first >= size) return Range::Unsatisfiable;
+    if (last < first) return Range::None;
+    return Range::Satisfiable;
+}
+
+// Write a complete payload, honoring a Range request if the client's copy
+// is still current according to If-Range.
+template<typename Req, typename Res>
+void writeCached(Req& req, Res& res, Headers h, const Data& payload)
+{
+    Trace::stamp(h);
+
+    h.emplace("Accept-Ranges", "bytes");
+
+    const auto range(req.header.find("Range"));
+    const auto ifRange(req.header.find("If-Range"));
+    const auto etag(h.find("ETag"));
+
+    const bool ranged(
+            range != req.header.end() &&
+            (ifRange == req.header.end() ||
+                (etag != h.end() && ifRange->second == etag->second)));
+
+    std::size_t first(0), last(0);
+    const Range result(ranged ?
+            parseRange(range->second, payload.size(), first, last) :
+            Range::None);
+
+    const std::string size(std::to_string(payload.size()));
+
+    if (result == Range::Satisfiable)
+    {
+        const std::size_t length(last - first + 1);
+        h.emplace(
+                "Content-Range",
+                "bytes " + std::to_string(first) + "-" +
+                std::to_string(last) + "/" + size);
+        h.emplace("Content-Length", std::to_string(length));
+        res.write(HttpStatusCode::success_partial_content, h);
+        res.write(payload.data() + first, length);
+    }
+    else if (result == Range::Unsatisfiable)
+    {
+        h.emplace("Content-Range", "bytes */" + size);
+        res.write(HttpStatusCode::client_error_range_not_satisfiable, "", h);
+    }
+    else
+    {
+        h.emplace("Content-Length", size);
+        res.write(h);
+        res.write(payload.data(), payload.size());
+    }
+}
+
+ResponseCache::Payload makePayload(const std::string& s)
+{
+    return std::make_shared<const Data>(s.begin(), s.end());
+}
+
+// Content coding for a compressible response to this request.
+template<typename Req>
+encoding::Coding negotiate(const Manager& manager, Req& req)
+{
+    const auto it(req.header.find("Accept-Encoding"));
+    if (it == req.header.end()) return encoding::Coding::Identity;
+    return manager.coding(it->second);
+}
+
+// Each coded representation needs an ETag of its own, since its bytes differ
+// from those of the identity representation.
+std::string codedEtag(const std::string& etag, const std::string& coding)
+{
+    if (coding.empty() || etag.size() < 2) return etag;
+    return etag.substr(0, etag.size() - 1) + "-" + coding + '"';
+}
+
+std::string codedEtag(const std::string& etag, const encoding::Coding coding)
+{
+    return codedEtag(etag, encoding::name(coding));
+}
+
+// The given coding of a payload, which is cached under its own key derived
+// from `key` so that each variant is encoded once rather than per request.
+// Concurrent requests for a variant being encoded wait for it.  Payloads
+// below the minimum size are returned as they are, with `coding` reset to
+// the identity.  An empty key bypasses the cache.  The generation is that of
+// the response cache from before `payload` was produced or looked up.
+ResponseCache::Payload coded(
+        const Manager& manager,
+        const std::string& key,
+        const ResponseCache::Payload& payload,
+        encoding::Coding& coding,
+        const std::vector<std::string>& sources,
+        const uint64_t generation)
+{
+    if (
+            coding == encoding::Coding::Identity ||
+            payload->size() < manager.compressMinBytes())
+    {
+        coding = encoding::Coding::Identity;
+        return payload;
+    }
+
+    auto encode([&]()
+    {
+        Trace::Scope scope("compress");
+        return std::make_shared<const Data>(encoding::encode(*payload, coding));
+    });
+
+    if (key.empty()) return encode();
+
+    auto& cache(manager.responseCache());
+    const std::string variant(key + "#" + encoding::name(coding));
+    if (auto result = cache.get(variant)) return result;
+
+    SingleFlight::Ticket ticket(manager.flights(), variant);
+    if (!ticket.leader())
+    {
+        if (auto result = ticket.wait()) return result;
+    }
+
+    ResponseCache::Payload result(encode());
+    cache.insert(variant, result, sources, generation);
+    ticket.complete(result);
+    return result;
+}
+
+struct Batch
+{
+    Data data;
+    uint32_t points = 0;
 };
 
-const std::map<Color, std::string> colorCodes {
-    { Color::Black,     "\x1b[30m" },
-    { Color::Red,       "\x1b[31m" },
-    { Color::Green,     "\x1b[32m" },
-    { Color::Yellow,    "\x1b[33m" },
-    { Color::Blue,      "\x1b[34m" },
-    { Color::Magenta,   "\x1b[35m" },
-    { Color::Cyan,      "\x1b[36m" },
-    { Color::White,     "\x1b[37m" }
+struct Count
+{
+    uint64_t points = 0;
+    uint64_t chunks = 0;
 };
 
-std::string color(const std::string& s, Color c)
+// If the schema requested by `q` can be packed from the reader's native
+// layout by a Converter, switch `q` to read natively and return that
+// Converter.  Otherwise `q` is left alone for entwine to convert.
+std::unique_ptr<Converter> readNatively(
+        const entwine::Reader& reader,
+        Json::Value& q)
 {
-    return colorCodes.at(c) + s + "\x1b[0m";
+    const entwine::Schema& native(reader.metadata().schema());
+    const entwine::Schema requested(q["schema"]);
+
+    auto converter(Converter::maybeCreate(native, requested));
+    if (converter) q["schema"] = native.toJson();
+    return converter;
 }
 
-std::mutex m;
+// Input stream adapter for pdal::LazPerfDecompressor, which reads encoded
+// bytes straight from a request body so that the compressed upload is never
+// copied as a whole.
+class BodyStream
+{
+public:
+    explicit BodyStream(std::istream& is) : m_is(is) { }
+
+    void getBytes(uint8_t* bytes, std::size_t length)
+    {
+        m_is.read(reinterpret_cast<char*>(bytes), length);
+        if (static_cast<std::size_t>(m_is.gcount()) != length) truncated();
+    }
+
+    uint8_t getByte()
+    {
+        const auto c(m_is.get());
+        if (c == std::char_traits<char>::eof()) truncated();
+        return static_cast<uint8_t>(c);
+    }
+
+private:
+    void truncated()
+    {
+        throw std::runtime_error("Compressed body ended unexpectedly");
+    }
+
+    std::istream& m_is;
+};
 
 } // unnamed namespace
 
-SharedReader& TimedReader::get()
+SharedReader TimedReader::get()
 {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    std::unique_lock<std::mutex> lock(m_mutex);
     m_touched = getNow();
     if (m_reader) return m_reader;
 
-    create();
+    if (m_missing && secondsSince(m_missingSince) < m_manager.notFoundSeconds())
+    {
+        throw HttpError(
+                HttpStatusCode::client_error_not_found,
+                "Not found: " + m_name);
+    }
+
+    if (!m_opening)
+    {
+        m_opening = true;
+        m_manager.openPool().add([this]() { open(); });
+    }
+
+    const bool done(m_cv.wait_for(
+            lock,
+            std::chrono::seconds(m_manager.openSeconds()),
+            [this]() { return !m_opening; }));
+
+    if (!done)
+    {
+        throw HttpError(
+                HttpStatusCode::server_error_service_unavailable,
+                "Still opening: " + m_name);
+    }
 
     if (!m_reader)
     {
@@ -87,43 +432,106 @@ SharedReader& TimedReader::get()
     else return m_reader;
 }
 
-void TimedReader::create()
+void TimedReader::open()
 {
     std::cout << "Creating " << m_name << std::endl;
 
-    for (const auto& path : m_manager.paths())
+    const auto& paths(m_manager.paths());
+
+    struct Probe
     {
-        std::cout << "\tTrying " << path << ": ";
+        SharedReader reader;
+        bool done = false;
+    };
 
-        try
-        {
-            entwine::arbiter::Endpoint ep(
-                    m_manager.outerScope().getArbiterPtr()->getEndpoint(
-                        entwine::arbiter::util::join(path, m_name)));
+    std::vector<Probe> probes(paths.size());
+    std::mutex mutex;
+    std::condition_variable cv;
 
-            entwine::arbiter::Endpoint tmp(
-                    m_manager.outerScope().getArbiterPtr()->getEndpoint(
-                        m_manager.config()["tmp"].asString()));
+    const std::size_t n(std::max<std::size_t>(paths.size(), 1));
+    entwine::Pool pool(n, n);
 
-            auto& cache(m_manager.cache());
+    for (std::size_t i(0); i < paths.size(); ++i)
+    {
+        pool.add([&, i]()
+        {
+            SharedReader reader(probe(paths[i]));
 
-            if (auto r = std::make_shared<entwine::Reader>(ep, tmp, cache))
-            {
-                std::cout << "SUCCESS" << std::endl;
-                m_reader = r;
-                return;
-            }
-            else std::cout << "fail - null result received" << std::endl;
-        }
-        catch (const std::exception& e)
+            std::lock_guard<std::mutex> lock(mutex);
+            probes[i].reader = reader;
+            probes[i].done = true;
+            cv.notify_all();
+        });
+    }
+
+    // Publish as soon as the earliest successful path is known, even if
+    // probes of later paths are still running.
+    SharedReader reader;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (std::size_t i(0); i < probes.size() && !reader; ++i)
         {
-            std::cout << "fail - " << e.what() << std::endl;
+            cv.wait(lock, [&probes, i]() { return probes[i].done; });
+            reader = probes[i].reader;
         }
-        catch (...)
+    }
+
+    opened(reader);
+    pool.join();
+}
+
+SharedReader TimedReader::probe(const std::string& path) const
+{
+    // Build each log line whole, since probes run concurrently.
+    const std::string prefix("\tTrying " + path + " for " + m_name + ": ");
+
+    try
+    {
+        entwine::arbiter::Endpoint ep(
+                m_manager.arbiter().getEndpoint(
+                    entwine::arbiter::util::join(path, m_name)));
+
+        entwine::arbiter::Endpoint tmp(
+                m_manager.arbiter().getEndpoint(
+                    m_manager.config()["tmp"].asString()));
+
+        auto& cache(m_manager.cache());
+
+        if (auto r = std::make_shared<entwine::Reader>(ep, tmp, cache))
         {
-            std::cout << "fail - unknown error" << std::endl;
+            std::cout << prefix + "SUCCESS" << std::endl;
+            return r;
         }
+        else std::cout << prefix + "fail - null result received" << std::endl;
+    }
+    catch (const std::exception& e)
+    {
+        std::cout << prefix + "fail - " + e.what() << std::endl;
     }
+    catch (...)
+    {
+        std::cout << prefix + "fail - unknown error" << std::endl;
+    }
+
+    return SharedReader();
+}
+
+void TimedReader::opened(SharedReader reader)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_reader = reader;
+        m_exists = !!reader;
+        m_points = reader ?
+            reader->metadata().manifest().pointStats().inserts() : 0;
+        m_bytes = reader ?
+            m_points * reader->metadata().schema().pointSize() : 0;
+        m_opening = false;
+        m_missing = !reader;
+        if (m_missing) m_missingSince = getNow();
+    }
+
+    m_cv.notify_all();
 }
 
 void TimedReader::reset()
@@ -132,6 +540,7 @@ void TimedReader::reset()
     {
         m_manager.cache().release(*m_reader);
         m_reader.reset();
+        m_exists = false;
     }
 }
 
@@ -144,6 +553,251 @@ Resource::Resource(
     , m_readers(readers)
 { }
 
+std::vector<std::string> Resource::sources() const
+{
+    std::vector<std::string> names;
+    for (const TimedReader* tr : m_readers) names.push_back(tr->name());
+    return names;
+}
+
+Resource::Info::Info(Json::Value j)
+    : json(std::move(j))
+    , styled(json.toStyledString())
+    , schema(json["schema"])
+    , hash(encoding::hash(styled))
+    , addons(std::any_of(
+                json["schema"].begin(),
+                json["schema"].end(),
+                [](const Json::Value& dim) { return dim["addon"].asBool(); }))
+{ }
+
+std::shared_ptr<const Resource::Info> Resource::cachedInfo() const
+{
+    std::lock_guard<std::mutex> lock(m_infoMutex);
+    if (!m_info)
+    {
+        m_info = std::make_shared<const Info>(
+                isSingle() ? infoSingle() : infoMulti());
+    }
+    return m_info;
+}
+
+void Resource::invalidate()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_depthCountsMutex);
+        m_depthCounts.clear();
+    }
+
+    std::lock_guard<std::mutex> lock(m_infoMutex);
+    m_info.reset();
+    ++m_writes;
+}
+
+// The hierarchy holds the number of points in each node of the tree, where
+// the nodes at depth d divide the cubic bounds of the resource into a grid
+// of 2^d cells along each axis.  So if the edges of the query bounds lie on
+// that grid at the first depth queried, then every node at that depth and
+// below is either entirely inside or entirely outside of the query, and the
+// sum of the hierarchy's counts is exact.  Queries with other options, such
+// as a filter or a scale and offset, are answered by a real count query.
+bool Resource::countFromHierarchy(const Json::Value& q, uint64_t& points) const
+{
+    for (const auto& key : q.getMemberNames())
+    {
+        if (
+                key != "bounds" && key != "depth" &&
+                key != "depthBegin" && key != "depthEnd" &&
+                key != "schema" && key != "compress")
+        {
+            return false;
+        }
+    }
+
+    std::size_t depthBegin(0);
+    std::size_t depthEnd(0);
+    if (q.isMember("depth"))
+    {
+        depthBegin = q["depth"].asUInt64();
+        depthEnd = depthBegin + 1;
+    }
+    else if (q.isMember("depthEnd"))
+    {
+        depthBegin = q["depthBegin"].asUInt64();
+        depthEnd = q["depthEnd"].asUInt64();
+    }
+    else return false;
+
+    const Json::Value& bounds(q["bounds"]);
+    if (!bounds.isNull() && bounds.size() != 4 && bounds.size() != 6)
+    {
+        return false;
+    }
+
+    uint64_t sum(0);
+    for (std::size_t i(0); i < m_readers.size(); ++i)
+    {
+        SharedReader reader(m_readers[i]->get());
+        const auto& meta(reader->metadata());
+        const entwine::Bounds& root(meta.boundsNativeCubic());
+
+        // Nothing is stored above the base depth.
+        const std::size_t begin(
+                std::max(depthBegin, meta.structure().baseDepthBegin()));
+        if (begin >= depthEnd) continue;
+        if (begin > 40) return false;
+
+        const double rootMin[] = { root.min().x, root.min().y, root.min().z };
+        const double rootMax[] = { root.max().x, root.max().y, root.max().z };
+
+        // Clamp the query to the resource, whose bounds are always aligned.
+        double query[6];
+        for (std::size_t d(0); d < 3; ++d)
+        {
+            query[d] = rootMin[d];
+            query[d + 3] = rootMax[d];
+        }
+        if (!bounds.isNull())
+        {
+            const std::size_t dims(bounds.size() / 2);
+            for (std::size_t d(0); d < dims; ++d)
+            {
+                query[d] = std::max(
+                        bounds[Json::ArrayIndex(d)].asDouble(),
+                        rootMin[d]);
+                query[d + 3] = std::min(
+                        bounds[Json::ArrayIndex(d + dims)].asDouble(),
+                        rootMax[d]);
+            }
+        }
+
+        bool empty(false);
+        for (std::size_t d(0); d < 3; ++d)
+        {
+            if (query[d] >= query[d + 3]) empty = true;
+
+            const double cells(static_cast<double>(1ull << begin));
+            const double size(rootMax[d] - rootMin[d]);
+            for (const double v : { query[d], query[d + 3] })
+            {
+                const double pos((v - rootMin[d]) / size * cells);
+                if (std::abs(pos - std::round(pos)) > 1e-6) return false;
+            }
+        }
+        if (empty) continue;
+
+        Json::Value box(Json::arrayValue);
+        for (const double v : query) box.append(v);
+
+        const std::string key(std::to_string(i) + dense(box));
+        DepthCounts memo;
+        {
+            std::lock_guard<std::mutex> lock(m_depthCountsMutex);
+            const auto it(m_depthCounts.find(key));
+            if (it != m_depthCounts.end()) memo = it->second;
+        }
+
+        const std::size_t end(memo.begin + memo.counts.size());
+        if (memo.counts.empty() || begin < memo.begin || depthEnd > end)
+        {
+            // Fetch a range covering both the memoized depths and the newly
+            // requested ones, so the memo only ever grows.
+            const std::size_t b(
+                    memo.counts.empty() ? begin : std::min(begin, memo.begin));
+            const std::size_t e(
+                    memo.counts.empty() ? depthEnd : std::max(depthEnd, end));
+
+            Json::Value hq;
+            hq["bounds"] = box;
+            hq["depthBegin"] = Json::UInt64(b);
+            hq["depthEnd"] = Json::UInt64(e);
+            hq["vertical"] = true;
+
+            Json::Value vertical;
+            {
+                Trace::Scope scope("run");
+                vertical = reader->hierarchy(hq);
+            }
+            if (!vertical.isArray()) return false;
+
+            // Depths beyond the deepest node are absent.
+            memo.begin = b;
+            memo.counts.assign(e - b, 0);
+            for (Json::ArrayIndex d(0); d < vertical.size() && d < e - b; ++d)
+            {
+                memo.counts[d] = vertical[d].asUInt64();
+            }
+
+            std::lock_guard<std::mutex> lock(m_depthCountsMutex);
+            if (m_depthCounts.size() >= maxDepthCounts) m_depthCounts.clear();
+            m_depthCounts[key] = memo;
+        }
+
+        for (std::size_t d(begin); d < depthEnd; ++d)
+        {
+            sum += memo.counts[d - memo.begin];
+        }
+    }
+
+    points = sum;
+    return true;
+}
+
+uint64_t Resource::estimatePoints(const std::vector<Json::Value>& queries) const
+{
+    uint64_t points(0);
+
+    // Queries that the hierarchy can't answer are counted by each reader,
+    // all at once.
+    std::vector<const Json::Value*> counted;
+    for (const Json::Value& q : queries)
+    {
+        uint64_t n(0);
+        if (countFromHierarchy(q, n)) points += n;
+        else counted.push_back(&q);
+    }
+
+    if (counted.empty()) return points;
+
+    const std::size_t readers(m_readers.size());
+    fanOut<uint64_t>(
+            counted.size() * readers,
+            m_manager.threads(),
+            [this, &counted, readers](std::size_t i)
+            {
+                SharedReader reader(m_readers.at(i % readers)->get());
+                auto query(reader->getCountQuery(*counted[i / readers]));
+                query->run();
+                return static_cast<uint64_t>(query->numPoints());
+            },
+            [&points](std::size_t i, uint64_t& n)
+            {
+                points += n;
+                return true;
+            });
+
+    return points;
+}
+
+std::string Resource::etag(
+        const std::string& endpoint,
+        const Json::Value& q) const
+{
+    const auto info(cachedInfo());
+
+    uint64_t h(encoding::hash(endpoint + "?" + dense(q), info->hash));
+    if (info->addons)
+    {
+        h = encoding::hash(
+                std::to_string(bootId) + "/" + std::to_string(m_writes),
+                h);
+    }
+
+    std::ostringstream ss;
+    ss << '"' << std::hex << std::setw(16) << std::setfill('0') << h << '"';
+    return ss.str();
+}
+
 Json::Value Resource::infoSingle() const
 {
     Json::Value json;
@@ -245,12 +899,36 @@ void Resource::info(Req& req, Res& res)
     h.erase("Cache-Control");
     h.emplace("Cache-Control", "public, max-age=1");
     h.emplace("Content-Type", "application/json");
-    res.write(getInfo().toStyledString(), h);
+    h.emplace("Vary", "Accept-Encoding");
+    const auto generation(m_manager.responseCache().generation(sources()));
+    const auto info(cachedInfo());
+
+    // Keyed by the info hash, so that variants of a replaced info are never
+    // served even if they outlive the invalidation.
+    std::ostringstream key;
+    key << ResponseCache::key("info", m_name, Json::Value()) << "/" <<
+        std::hex << info->hash;
+
+    auto coding(negotiate(m_manager, req));
+    const auto payload(
+            coded(
+                m_manager,
+                key.str(),
+                makePayload(info->styled),
+                coding,
+                sources(),
+                generation));
+
+    if (coding != encoding::Coding::Identity)
+    {
+        h.emplace("Content-Encoding", encoding::name(coding));
+    }
+    writeCached(req, res, h, *payload);
 
-    std::lock_guard<std::mutex> lock(m);
-    std::cout << m_name << "/" << color("info", Color::Green) << ": " <<
-        color(std::to_string(msSince(start)), Color::Magenta) << " ms" <<
-        std::endl;
+    AccessLog::Entry entry(m_name, "info", Json::Value());
+    entry.bytes = payload->size();
+    entry.ms = msSince(start);
+    m_manager.record(std::move(entry));
 }
 
 template<typename Req, typename Res>
@@ -264,26 +942,103 @@ void Resource::hierarchy(Req& req, Res& res)
     }
 
     const Json::Value q(parseQuery(req));
-    const Json::Value result(m_readers.front()->get()->hierarchy(q));
+
+    // The binary encoding may be selected by either the query or the Accept
+    // header, so the encoding is made part of the cache key.
+    const auto accept(req.header.find("Accept"));
+    const bool binary(
+            q["format"].asString() == "binary" ||
+            (accept != req.header.end() &&
+             accept->second.find("application/octet-stream") !=
+                std::string::npos));
+    const bool compress(q["compress"].asBool());
+
+    // The `compress` option's zlib stream is only labeled as a content coding
+    // for clients that accept it, since otherwise their HTTP stack may fail
+    // to decode it.  Others receive it as opaque bytes to inflate themselves.
+    const auto acceptEncoding(req.header.find("Accept-Encoding"));
+    const bool deflated(
+            compress &&
+            acceptEncoding != req.header.end() &&
+            encoding::accepts(acceptEncoding->second, "deflate"));
+
+    const std::string endpoint(binary ? "hierarchy-binary" : "hierarchy");
+    const std::string etag(
+            codedEtag(this->etag(endpoint, q), deflated ? "deflate" : ""));
+
+    // Only uncompressed JSON is compressed by negotiation, since the binary
+    // encoding is already compact and `compress` has a coding of its own.
+    auto coding(
+            binary || compress ?
+                encoding::Coding::Identity : negotiate(m_manager, req));
+
     auto h(m_manager.headers());
-    h.emplace("Content-Type", "application/json");
-    res.write(dense(result), h);
+    h.emplace("Vary", "Accept, Accept-Encoding");
 
-    std::lock_guard<std::mutex> lock(m);
-    std::cout << m_name << "/" << color("hier", Color::Yellow) << ": " <<
-        color(std::to_string(msSince(start)), Color::Magenta) << " ms ";
+    // Payloads below the compression threshold are sent uncompressed, which
+    // is not known until the payload exists, so either ETag may be current.
+    const std::string codedTag(codedEtag(etag, coding));
+    if (notModified(req, etag) || notModified(req, codedTag))
+    {
+        h.emplace("ETag", notModified(req, codedTag) ? codedTag : etag);
+        res.write(HttpStatusCode::redirection_not_modified, h);
+
+        AccessLog::Entry entry(m_name, "hierarchy", q);
+        entry.cached = true;
+        entry.ms = msSince(start);
+        m_manager.record(std::move(entry));
+        return;
+    }
 
-    std::cout << "D: [";
-    if (q.isMember("depthBegin")) std::cout << q["depthBegin"].asUInt();
-    else if (q.isMember("depth")) std::cout << q["depth"].asUInt();
-    else std::cout << "all";
+    auto& cache(m_manager.responseCache());
+    const std::string key(ResponseCache::key(endpoint, m_name, q));
+    const auto generation(cache.generation(sources()));
+    auto payload(cache.get(key));
+    const bool cached(!!payload);
 
-    std::cout << ", ";
-    if (q.isMember("depthEnd")) std::cout << q["depthEnd"].asUInt();
-    else if (q.isMember("depth")) std::cout << q["depth"].asUInt() + 1;
-    else std::cout << "all";
+    if (!payload)
+    {
+        Json::Value json;
+        {
+            Trace::Scope scope("run");
+            json = m_readers.front()->get()->hierarchy(q);
+        }
+
+        Trace::Scope scope("encode");
 
-    std::cout << ")" << std::endl;
+        Data data;
+        if (binary) data = encoding::hierarchy(json);
+        else
+        {
+            const std::string s(dense(json));
+            data.assign(s.begin(), s.end());
+        }
+
+        if (compress) data = encoding::deflate(data);
+
+        payload = std::make_shared<const Data>(std::move(data));
+        cache.insert(key, payload, sources(), generation);
+    }
+
+    payload = coded(m_manager, key, payload, coding, sources(), generation);
+
+    h.emplace("ETag", codedEtag(etag, coding));
+    h.emplace(
+            "Content-Type",
+            binary || (compress && !deflated) ?
+                "application/octet-stream" : "application/json");
+    if (deflated) h.emplace("Content-Encoding", "deflate");
+    else if (coding != encoding::Coding::Identity)
+    {
+        h.emplace("Content-Encoding", encoding::name(coding));
+    }
+    writeCached(req, res, h, *payload);
+
+    AccessLog::Entry entry(m_name, "hierarchy", q);
+    entry.bytes = payload->size();
+    entry.cached = cached;
+    entry.ms = msSince(start);
+    m_manager.record(std::move(entry));
 }
 
 template<typename Req, typename Res>
@@ -302,6 +1057,7 @@ void Resource::files(Req& req, Res& res)
 
     const std::string root(req.path_match[2]);
     Json::Value query(parseQuery(req));
+    std::string body;
 
     if (root.size())
     {
@@ -321,7 +1077,7 @@ void Resource::files(Req& req, Res& res)
     {
         // For a root-level /files query, return a JSON array of all paths.
         const auto paths(reader->metadata().manifest().paths());
-        res.write(dense(entwine::toJsonArray(paths)), h);
+        body = dense(entwine::toJsonArray(paths));
     }
     else if (query.isObject())
     {
@@ -368,15 +1124,27 @@ void Resource::files(Req& req, Res& res)
             else for (const auto& v : search) result.append(single(v));
         }
 
-        res.write(dense(result), h);
+        body = dense(result);
     }
     else throw Http400("Invalid files query");
 
-    std::lock_guard<std::mutex> lock(m);
-    std::cout << m_name << "/" << color("file", Color::Green) << ": " <<
-        color(std::to_string(msSince(start)), Color::Magenta) << " ms " <<
-        "Q: " << (root.size() ? root : dense(query)) <<
-        std::endl;
+    // These responses are not cached, so they are compressed per request.
+    h.emplace("Vary", "Accept-Encoding");
+    auto coding(negotiate(m_manager, req));
+    const auto payload(
+            coded(m_manager, "", makePayload(body), coding, sources(), 0));
+
+    if (coding != encoding::Coding::Identity)
+    {
+        h.emplace("Content-Encoding", encoding::name(coding));
+    }
+    writeCached(req, res, h, *payload);
+
+    AccessLog::Entry entry(m_name, "files", Json::Value());
+    entry.bytes = payload->size();
+    entry.query = root.size() ? root : dense(query);
+    entry.ms = msSince(start);
+    m_manager.record(std::move(entry));
 }
 
 template<typename Req, typename Res>
@@ -386,115 +1154,394 @@ void Resource::read(Req& req, Res& res)
 
     Json::Value q(parseQuery(req));
 
-    if (!q.isMember("schema")) q["schema"] = getInfo()["schema"];
+    const auto info(cachedInfo());
+    const bool nativeSchema(!q.isMember("schema"));
+    if (nativeSchema) q["schema"] = info->json["schema"];
+
+    // Validate the client's copy before doing any work.
+    const std::string etag(this->etag("read", q));
+    if (notModified(req, etag))
+    {
+        auto h(m_manager.headers());
+        h.emplace("ETag", etag);
+        res.write(HttpStatusCode::redirection_not_modified, h);
+
+        AccessLog::Entry entry(m_name, "read", q);
+        entry.cached = true;
+        entry.ms = msSince(start);
+        m_manager.record(std::move(entry));
+        return;
+    }
+
+    auto& cache(m_manager.responseCache());
+    const std::string key(ResponseCache::key("read", m_name, q));
+
+    auto serve([&](const ResponseCache::Payload& payload)
+    {
+        auto h(m_manager.headers());
+        h.emplace("Content-Type", "binary/octet-stream");
+        h.emplace("ETag", etag);
+        writeCached(req, res, h, *payload);
+
+        uint32_t points(0);
+        std::copy(
+                payload->end() - sizeof(uint32_t),
+                payload->end(),
+                reinterpret_cast<char*>(&points));
+
+        AccessLog::Entry entry(m_name, "read", q);
+        entry.points = points;
+        entry.bytes = payload->size();
+        entry.cached = true;
+        entry.ms = msSince(start);
+        m_manager.record(std::move(entry));
+    });
+
+    const auto generation(cache.generation(sources()));
+    if (auto payload = cache.get(key)) return serve(payload);
+
+    // If an identical query is already running, share its result rather than
+    // running it again.  Followers can only be handed a response that the
+    // leader captured, so don't coalesce when the cache is disabled or when
+    // the hierarchy tells us the response is too large to retain - waiting
+    // would only delay running the query ourselves.  If the result still
+    // turns out to be unavailable, because the leader failed or compressed
+    // less than expected, then fall through and run it anyway.
+    uint64_t estimate(0);
+    const bool coalesce(
+            cache.maxEntryBytes() &&
+            ((q.isMember("compress") && q["compress"].asBool()) ||
+             !countFromHierarchy(q, estimate) ||
+             estimate * entwine::Schema(q["schema"]).pointSize() <=
+                cache.maxEntryBytes()));
+
+    std::unique_ptr<SingleFlight::Ticket> ticket;
+    if (coalesce)
+    {
+        ticket = entwine::makeUnique<SingleFlight::Ticket>(
+                m_manager.flights(),
+                key);
 
-    /*
+        if (!ticket->leader())
+        {
+            if (auto payload = ticket->wait()) return serve(payload);
+        }
+    }
+
+    // Budgets only apply to reads that actually run, since cached and
+    // coalesced responses are cheap.
+    auto& admission(m_manager.admission());
+    const auto slot(admission.acquire(m_name));
+
+    if (admission.maxPoints())
+    {
+        admission.checkPoints(estimatePoints(std::vector<Json::Value> { q }));
+    }
+
+    auto h(m_manager.headers());
+    h.emplace("ETag", etag);
+    Chunker<Res> chunker(res, h, m_manager.buffers());
+    chunker.capture(cache.maxEntryBytes());
+    chunker.whole([&](const Headers& headers, const Data& payload)
+    {
+        writeCached(req, res, headers, payload);
+    });
+    auto& data(chunker.data());
+
+    // Compressed output is appended straight into the Chunker's buffer, so
+    // each batch is encoded and flushed as soon as it arrives.
     using Compressor = pdal::LazPerfCompressor<Stream>;
-    Stream stream;
+    Stream stream(data);
     std::unique_ptr<Compressor> compressor;
     if (q.isMember("compress") && q["compress"].asBool())
     {
-        const entwine::Schema schema(q["schema"]);
-        const auto dimTypes(schema.pdalLayout().dimTypes());
+        const auto dimTypes(nativeSchema ?
+                info->schema.pdalLayout().dimTypes() :
+                entwine::Schema(q["schema"]).pdalLayout().dimTypes());
         compressor = entwine::makeUnique<Compressor>(stream, dimTypes);
     }
-    */
-
-    Chunker<Res> chunker(res, m_manager.headers());
-    auto& data(chunker.data());
 
     uint32_t points(0);
+    auto& buffers(m_manager.buffers());
 
-    for (std::size_t i(0); i < m_readers.size(); ++i)
+    auto push([&](Data& batch)
     {
-        TimedReader* reader(m_readers.at(i));
-        auto query(reader->get()->getQuery(q));
+        if (compressor)
+        {
+            Trace::Scope scope("compress");
+            compressor->compress(batch.data(), batch.size());
+        }
+        else chunker.append(std::move(batch));
+        batch.clear();
 
-        query->run();
-        data.insert(data.end(), query->data().begin(), query->data().end());
-        points += query->numPoints();
+        chunker.write();
+    });
 
-        if (chunker.canceled()) break;
-    }
+    if (isSingle())
+    {
+        // Send each batch as soon as the query produces it, so we only ever
+        // hold roughly one batch of point data for this request.
+        SharedReader reader(m_readers.front()->get());
 
-    if (q.isMember("compress") && q["compress"].asBool())
+        Json::Value rq(q);
+        std::unique_ptr<Converter> converter;
+        if (!nativeSchema) converter = readNatively(*reader, rq);
+
+        auto query([&]()
+        {
+            Trace::Scope scope("query");
+            return reader->getQuery(rq);
+        }());
+
+        while (!query->done() && !chunker.canceled())
+        {
+            {
+                Trace::Scope scope("run");
+                query->next();
+            }
+
+            if (converter)
+            {
+                Data& native(query->data());
+                Data batch(buffers.acquire(
+                        native.size() / converter->inPointSize() *
+                        converter->outPointSize()));
+                {
+                    Trace::Scope scope("convert");
+                    converter->convert(native, batch);
+                }
+                native.clear();
+
+                push(batch);
+                buffers.release(std::move(batch));
+            }
+            else push(query->data());
+        }
+
+        points += query->numPoints();
+    }
+    else
     {
-        const entwine::Schema schema(q["schema"]);
-        data = *entwine::Compression::compress(data, schema);
+        // Run the per-reader queries in parallel, and stitch their results
+        // together in reader order so the response is deterministic.
+        fanOut<Batch>(
+                m_readers.size(),
+                m_manager.threads(),
+                [this, &q, nativeSchema](std::size_t i)
+                {
+                    SharedReader reader(m_readers.at(i)->get());
+
+                    Json::Value rq(q);
+                    std::unique_ptr<Converter> converter;
+                    if (!nativeSchema) converter = readNatively(*reader, rq);
+
+                    auto query([&]()
+                    {
+                        Trace::Scope scope("query");
+                        return reader->getQuery(rq);
+                    }());
+                    {
+                        Trace::Scope scope("run");
+                        query->run();
+                    }
+
+                    Batch batch;
+                    if (converter)
+                    {
+                        Trace::Scope scope("convert");
+                        converter->convert(query->data(), batch.data);
+                    }
+                    else std::swap(batch.data, query->data());
+                    batch.points = query->numPoints();
+                    return batch;
+                },
+                [&](std::size_t i, Batch& batch)
+                {
+                    push(batch.data);
+                    points += batch.points;
+                    return !chunker.canceled();
+                });
     }
-    /*
-    if (compressor)
+
+    if (compressor && !chunker.canceled())
     {
-        compressor->compress(data.data(), data.size());
+        Trace::Scope scope("compress");
         compressor->done();
-        data = std::move(stream.data());
     }
-    */
 
-    const char* pos(reinterpret_cast<const char*>(&points));
-    data.insert(data.end(), pos, pos + sizeof(uint32_t));
+    if (!chunker.canceled())
+    {
+        const char* pos(reinterpret_cast<const char*>(&points));
+        data.insert(data.end(), pos, pos + sizeof(uint32_t));
 
-    chunker.write(true);
+        chunker.write(true);
 
-    /*
-    for (std::size_t i(0); i < m_readers.size(); ++i)
+        if (auto captured = chunker.captured())
+        {
+            const ResponseCache::Payload payload(std::move(captured));
+            cache.insert(key, payload, sources(), generation);
+            if (ticket && ticket->leader()) ticket->complete(payload);
+        }
+    }
+
+    AccessLog::Entry entry(m_name, "read", q);
+    entry.points = points;
+    entry.bytes = chunker.bytes();
+    entry.canceled = chunker.canceled();
+    entry.ms = msSince(start);
+    m_manager.record(std::move(entry));
+}
+
+template<typename Req, typename Res>
+void Resource::batch(Req& req, Res& res)
+{
+    const auto start(getNow());
+
+    Json::Value q(parseQuery(req));
+
+    const Json::Value nodes(q["nodes"]);
+    q.removeMember("nodes");
+
+    if (!nodes.isArray() || nodes.empty())
     {
-        TimedReader* reader(m_readers.at(i));
-        auto query(reader->get()->getQuery(q));
+        throw std::runtime_error("Batch requires a nonempty nodes array");
+    }
 
-        while (!query->done() && !chunker.canceled())
-        {
-            query->next();
-            done = (i == m_readers.size() - 1) && query->done();
+    const auto info(cachedInfo());
+    if (!q.isMember("schema")) q["schema"] = info->json["schema"];
 
-            auto& qdata(query->data());
-            if (data.empty()) data = std::move(qdata);
-            else data.insert(data.end(), qdata.begin(), qdata.end());
-            qdata.clear();
+    // Each node is a read query, made up of the shared options overridden
+    // by its own, so its segment is exactly what /read would return for it.
+    std::vector<Json::Value> queries;
+    for (const Json::Value& node : nodes)
+    {
+        if (!node.isObject()) throw std::runtime_error("Invalid batch node");
 
-            if (compressor)
-            {
-                compressor->compress(data.data(), data.size());
-                if (done) compressor->done();
-                data = std::move(stream.data());
-            }
+        Json::Value nq(q);
+        for (const auto key : node.getMemberNames()) nq[key] = node[key];
+        queries.push_back(nq);
+    }
+
+    auto& admission(m_manager.admission());
+    const auto slot(admission.acquire(m_name));
 
-            if (query->done()) points += query->numPoints();
+    if (admission.maxPoints()) admission.checkPoints(estimatePoints(queries));
 
-            if (done)
+    auto& cache(m_manager.responseCache());
+
+    struct Segment
+    {
+        ResponseCache::Payload payload;
+        bool cached = false;
+    };
+
+    Chunker<Res> chunker(res, m_manager.headers(), m_manager.buffers());
+    auto& data(chunker.data());
+
+    uint64_t points(0);
+    std::size_t hits(0);
+
+    const auto generation(cache.generation(sources()));
+
+    fanOut<Segment>(
+            queries.size(),
+            m_manager.threads(),
+            [&](std::size_t i)
             {
-                const char* pos(reinterpret_cast<const char*>(&points));
-                data.insert(data.end(), pos, pos + sizeof(uint32_t));
-            }
+                Segment segment;
 
-            chunker.write(done);
-        }
+                const Json::Value& nq(queries[i]);
+                const std::string key(ResponseCache::key("read", m_name, nq));
 
-        if (chunker.canceled()) break;
-    }
-    */
+                if ((segment.payload = cache.get(key)))
+                {
+                    segment.cached = true;
+                    return segment;
+                }
 
-    std::lock_guard<std::mutex> lock(m);
-    std::cout << m_name << "/" << color("read", Color::Cyan) << ": " <<
-        color(std::to_string(msSince(start)), Color::Magenta) << " ms";
+                // A node may override the shared schema and compression.
+                Data out;
+                Stream stream(out);
+                using Compressor = pdal::LazPerfCompressor<Stream>;
+                std::unique_ptr<Compressor> compressor;
+                if (nq.isMember("compress") && nq["compress"].asBool())
+                {
+                    const entwine::Schema schema(nq["schema"]);
+                    compressor = entwine::makeUnique<Compressor>(
+                            stream,
+                            schema.pdalLayout().dimTypes());
+                }
 
-    std::cout << " D: [";
-    if (q.isMember("depthBegin")) std::cout << q["depthBegin"].asUInt();
-    else if (q.isMember("depth")) std::cout << q["depth"].asUInt();
-    else std::cout << "all";
+                uint32_t n(0);
+                for (TimedReader* tr : m_readers)
+                {
+                    SharedReader reader(tr->get());
+
+                    Json::Value rq(nq);
+                    const auto converter(readNatively(*reader, rq));
+
+                    auto query(reader->getQuery(rq));
+                    {
+                        Trace::Scope scope("run");
+                        query->run();
+                    }
+
+                    Data converted;
+                    if (converter)
+                    {
+                        converter->convert(query->data(), converted);
+                    }
+
+                    Data& batch(converter ? converted : query->data());
+                    if (compressor)
+                    {
+                        compressor->compress(batch.data(), batch.size());
+                    }
+                    else if (out.empty()) std::swap(out, batch);
+                    else out.insert(out.end(), batch.begin(), batch.end());
+
+                    n += query->numPoints();
+                }
 
-    std::cout << ", ";
-    if (q.isMember("depthEnd")) std::cout << q["depthEnd"].asUInt();
-    else if (q.isMember("depth")) std::cout << q["depth"].asUInt() + 1;
-    else std::cout << "all";
+                if (compressor) compressor->done();
 
-    std::cout << ")";
-    std::cout << " P: " << points;
+                const char* pos(reinterpret_cast<const char*>(&n));
+                out.insert(out.end(), pos, pos + sizeof(uint32_t));
 
-    if (q.isMember("filter")) std::cout << " F: " << dense(q["filter"]);
-    if (chunker.canceled()) std::cout << " " << color("canceled", Color::Red);
+                segment.payload = std::make_shared<const Data>(std::move(out));
+                cache.insert(key, segment.payload, sources(), generation);
+                return segment;
+            },
+            [&](std::size_t i, Segment& segment)
+            {
+                // Each segment is framed by its little-endian byte length.
+                const Data& payload(*segment.payload);
+                const uint32_t size(payload.size());
+                const char* pos(reinterpret_cast<const char*>(&size));
+                data.insert(data.end(), pos, pos + sizeof(uint32_t));
+                data.insert(data.end(), payload.begin(), payload.end());
+
+                uint32_t n(0);
+                std::copy(
+                        payload.end() - sizeof(uint32_t),
+                        payload.end(),
+                        reinterpret_cast<char*>(&n));
+                points += n;
+                if (segment.cached) ++hits;
+
+                chunker.write();
+                return !chunker.canceled();
+            });
+
+    if (!chunker.canceled()) chunker.write(true);
 
-    std::cout << std::endl;
+    AccessLog::Entry entry(m_name, "batch", q);
+    entry.points = points;
+    entry.bytes = chunker.bytes();
+    entry.cached = hits == queries.size();
+    entry.canceled = chunker.canceled();
+    entry.ms = msSince(start);
+    m_manager.record(std::move(entry));
 }
 
 template<typename Req, typename Res>
@@ -504,45 +1551,70 @@ void Resource::count(Req& req, Res& res)
 
     uint64_t points(0);
     uint64_t chunks(0);
+    bool counted(true);
 
     const Json::Value q(parseQuery(req));
 
-    for (TimedReader* reader : m_readers)
+    auto& cache(m_manager.responseCache());
+    const std::string key(ResponseCache::key("count", m_name, q));
+    const auto generation(cache.generation(sources()));
+    auto payload(cache.get(key));
+    const bool cached(!!payload);
+
+    if (payload)
     {
-        auto query(reader->get()->getCountQuery(q));
-        query->run();
-        points += query->numPoints();
-        chunks += query->chunks();
+        const Json::Value result(
+                entwine::parse(std::string(payload->begin(), payload->end())));
+        points = result["points"].asUInt64();
     }
+    else if (countFromHierarchy(q, points)) counted = false;
+    else fanOut<Count>(
+            m_readers.size(),
+            m_manager.threads(),
+            [this, &q](std::size_t i)
+            {
+                SharedReader reader(m_readers.at(i)->get());
+                auto query(reader->getCountQuery(q));
+                {
+                    Trace::Scope scope("run");
+                    query->run();
+                }
 
-    Json::Value result;
-    result["points"] = static_cast<Json::UInt64>(points);
-    result["chunks"] = static_cast<Json::UInt64>(chunks);
-
-    auto h(m_manager.headers());
-    h.emplace("Content-Type", "application/json");
-    res.write(dense(result), h);
-
-    std::lock_guard<std::mutex> lock(m);
-    std::cout << m_name << "/" << color("count", Color::Cyan) << ": " <<
-        color(std::to_string(msSince(start)), Color::Magenta) << " ms";
-
-    std::cout << " D: [";
-    if (q.isMember("depthBegin")) std::cout << q["depthBegin"].asUInt();
-    else if (q.isMember("depth")) std::cout << q["depth"].asUInt();
-    else std::cout << "all";
+                Count count;
+                count.points = query->numPoints();
+                count.chunks = query->chunks();
+                return count;
+            },
+            [&points, &chunks](std::size_t i, Count& count)
+            {
+                points += count.points;
+                chunks += count.chunks;
+                return true;
+            });
 
-    std::cout << ", ";
-    if (q.isMember("depthEnd")) std::cout << q["depthEnd"].asUInt();
-    else if (q.isMember("depth")) std::cout << q["depth"].asUInt() + 1;
-    else std::cout << "all";
+    if (!payload)
+    {
+        Json::Value result;
+        result["points"] = static_cast<Json::UInt64>(points);
 
-    std::cout << ")";
-    std::cout << " P: " << points;
+        // No chunks are fetched for a count answered from the hierarchy, so
+        // there is no meaningful chunk count to report.
+        if (counted) result["chunks"] = static_cast<Json::UInt64>(chunks);
 
-    if (q.isMember("filter")) std::cout << " F: " << dense(q["filter"]);
+        payload = makePayload(dense(result));
+        cache.insert(key, payload, sources(), generation);
+    }
 
-    std::cout << std::endl;
+    auto h(m_manager.headers());
+    h.emplace("Content-Type", "application/json");
+    writeCached(req, res, h, *payload);
+
+    AccessLog::Entry entry(m_name, "count", q);
+    entry.points = points;
+    entry.bytes = payload->size();
+    entry.cached = cached;
+    entry.ms = msSince(start);
+    m_manager.record(std::move(entry));
 }
 
 template<typename Req, typename Res>
@@ -561,63 +1633,102 @@ void Resource::write(Req& req, Res& res)
     SharedReader reader(m_readers.front()->get());
     const entwine::Schema schema(q["schema"]);
 
-    if (schema.pointSize()) reader->registerAppend(name, schema);
+    if (schema.pointSize())
+    {
+        reader->registerAppend(name, schema);
+        m_manager.invalidate(m_readers.front()->name());
+    }
 
     const std::size_t size(req.content.size());
 
-    std::vector<char> data;
-    data.reserve(size);
-    data.assign(
-            (std::istreambuf_iterator<char>(req.content)),
-            std::istreambuf_iterator<char>());
-    if (data.size() != size) throw std::runtime_error("Invalid size");
+    // Uploads hold a slot like reads do, since each one holds its decoded
+    // points in memory until the append completes.
+    const auto slot(m_manager.admission().acquire(m_name));
 
-    if (q.isMember("compress") && q["compress"].asBool())
+    const bool compress(q.isMember("compress") && q["compress"].asBool());
+    const std::size_t pointSize(schema.pointSize());
+    std::size_t np(0);
+
+    if (compress)
     {
-        std::size_t np(0);
         const auto npIt(req.header.find("NumPoints"));
-        if (npIt != req.header.end()) np = std::stoull(npIt->second);
-        else throw std::runtime_error("NumPoints header is missing");
+        if (npIt == req.header.end())
+        {
+            throw std::runtime_error("NumPoints header is missing");
+        }
+
+        try { np = std::stoull(npIt->second); }
+        catch (...) { throw Http400("Invalid NumPoints header"); }
 
-        if (const auto d = entwine::Compression::decompress(data, schema, np))
+        if (!pointSize) throw std::runtime_error("Invalid schema");
+
+        // The declared count sizes our buffer before any of the body has
+        // been decoded, so it is bounded like the points selected by a read.
+        if (np > std::numeric_limits<std::size_t>::max() / pointSize)
         {
-            data = std::move(*d);
+            throw HttpError(
+                    HttpStatusCode::client_error_payload_too_large,
+                    "NumPoints is too large");
         }
-        else throw std::runtime_error("Could not decompress buffer");
+        m_manager.admission().checkPoints(np);
     }
 
-    const std::size_t points(reader->write(name, data, q));
+    BufferPool::Lease lease(
+            m_manager.buffers(),
+            compress ? np * pointSize : size);
+    Data& data(lease.data());
 
-    res.write("", m_manager.headers());
+    if (compress)
+    {
+        // Decode the body in blocks as it is read, into a buffer sized for
+        // exactly the declared number of points.
+        data.resize(np * pointSize);
 
-    if (!points) return;
+        BodyStream stream(req.content);
+        pdal::LazPerfDecompressor<BodyStream> decompressor(
+                stream,
+                schema.pdalLayout().dimTypes());
 
-    std::lock_guard<std::mutex> lock(m);
-    std::cout << m_name << "/" << color("write", Color::Yellow) << ": " <<
-        color(std::to_string(msSince(start)), Color::Magenta) << " ms";
+        const std::size_t blockBytes(pointSize * 4096);
+        for (std::size_t pos(0); pos < data.size(); pos += blockBytes)
+        {
+            decompressor.decompress(
+                    data.data() + pos,
+                    std::min(blockBytes, data.size() - pos));
+        }
+    }
+    else
+    {
+        data.resize(size);
+        req.content.read(data.data(), size);
+        if (static_cast<std::size_t>(req.content.gcount()) != size)
+        {
+            throw std::runtime_error("Invalid size");
+        }
+    }
 
-    std::cout << " D: [";
-    if (q.isMember("depthBegin")) std::cout << q["depthBegin"].asUInt();
-    else if (q.isMember("depth")) std::cout << q["depth"].asUInt();
-    else std::cout << "all";
+    const std::size_t points(reader->write(name, data, q));
 
-    std::cout << ", ";
-    if (q.isMember("depthEnd")) std::cout << q["depthEnd"].asUInt();
-    else if (q.isMember("depth")) std::cout << q["depth"].asUInt() + 1;
-    else std::cout << "all";
+    // Appended data may change the results of any cached query or info that
+    // touches this resource, including via aliases.
+    m_manager.invalidate(m_readers.front()->name());
 
-    std::cout << ")";
-    std::cout << " P: " << points;
+    res.write("", m_manager.headers());
 
-    if (q.isMember("filter")) std::cout << " F: " << dense(q["filter"]);
+    if (!points) return;
 
-    std::cout << std::endl;
+    AccessLog::Entry entry(m_name, "write", q);
+    entry.points = points;
+    entry.bytes = size;
+    entry.ms = msSince(start);
+    m_manager.record(std::move(entry));
 }
 
 template void Resource::info(Http::Request&, Http::Response&);
 template void Resource::hierarchy(Http::Request&, Http::Response&);
 template void Resource::files(Http::Request&, Http::Response&);
 template void Resource::read(Http::Request&, Http::Response&);
+template void Resource::batch(Http::Request&, Http::Response&);
 template void Resource::count(Http::Request&, Http::Response&);
 template void Resource::write(Http::Request&, Http::Response&);
 
@@ -625,6 +1736,7 @@ template void Resource::info(Https::Request&, Https::Response&);
 template void Resource::hierarchy(Https::Request&, Https::Response&);
 template void Resource::files(Https::Request&, Https::Response&);
 template void Resource::read(Https::Request&, Https::Response&);
+template void Resource::batch(Https::Request&, Https::Response&);
 template void Resource::count(Https::Request&, Https::Response&);
 template void Resource::write(Https::Request&, Https::Response&);
 
@@ -1,8 +1,15 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <map>
 #include <memory>
 #include <mutex>
 
+#include <json/json.h>
+
+#include <entwine/types/schema.hpp>
+
 #include <greyhound/defs.hpp>
 
 namespace entwine { class Reader; }
@@ -24,23 +31,55 @@ public:
     { }
 
     const std::string& name() const { return m_name; }
-    SharedReader& get();
-    std::size_t since() const { return secondsSince(m_touched); }
+
+    // The returned reader remains valid for as long as the caller holds it,
+    // even if this resource is swept in the meantime.
+    SharedReader get();
+
+    std::size_t since() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return secondsSince(m_touched);
+    }
     std::mutex& mutex() { return m_mutex; }
 
-    bool exists() const { return !!m_reader; }
+    bool exists() const { return m_exists; }
     void reset();
 
+    // Point count of the open reader, as a proxy for the size of its
+    // metadata, hierarchy, and cache residency.
+    std::size_t points() const { return m_points; }
+
+    // Size of the open reader's points in their native layout, which bounds
+    // the chunk cache memory that it may hold.
+    std::size_t bytes() const { return m_bytes; }
+
 private:
-    void create();
+    // Runs in the background, probing all paths in parallel.  The first
+    // path in configured order that holds this resource is used.
+    void open();
+    SharedReader probe(const std::string& path) const;
+    void opened(SharedReader reader);
 
     Manager& m_manager;
     std::string m_name;
 
     TimePoint m_touched;
     SharedReader m_reader;
+    std::atomic<bool> m_exists{false};
+    std::atomic<std::size_t> m_points{0};
+    std::atomic<std::size_t> m_bytes{0};
+
+    // While an open is in progress, requests for this resource wait for its
+    // outcome rather than starting their own.  A failed open is remembered
+    // for a while, so that repeated requests for a missing resource do not
+    // repeatedly probe every path.
+    bool m_opening = false;
+    bool m_missing = false;
+    TimePoint m_missingSince;
 
     mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
 };
 
 class Resource
@@ -57,6 +96,7 @@ public:
     template<typename Req, typename Res> void hierarchy(Req& req, Res& res);
     template<typename Req, typename Res> void files(Req& req, Res& res);
     template<typename Req, typename Res> void read(Req& req, Res& res);
+    template<typename Req, typename Res> void batch(Req& req, Res& res);
     template<typename Req, typename Res> void count(Req& req, Res& res);
     template<typename Req, typename Res> void write(Req& req, Res& res);
 
@@ -67,18 +107,72 @@ public:
 
     bool isSingle() const { return m_readers.size() == 1; }
     bool isMulti() const { return !isSingle(); }
-    Json::Value getInfo() const
+    // The info document for this resource along with its serialization and
+    // parsed schema.  These are computed once and shared across requests
+    // until the addon set changes.
+    struct Info
     {
-        return isSingle() ? infoSingle() : infoMulti();
-    }
+        explicit Info(Json::Value json);
+
+        const Json::Value json;
+        const std::string styled;
+        const entwine::Schema schema;
+
+        // Hash of the serialized info, and whether any dimensions have been
+        // appended, for use in cache validators.
+        const uint64_t hash;
+        const bool addons;
+    };
+
+    std::shared_ptr<const Info> cachedInfo() const;
+    Json::Value getInfo() const { return cachedInfo()->json; }
+
+    // Discard the cached info, which will be recomputed on its next use.
+    void invalidate();
+
+    // A strong entity tag for the response to this query, which changes
+    // along with the resource's metadata and addon set.  Since appended data
+    // is only tracked by this process, resources with addons also have their
+    // tags changed by every write and by restarts.
+    std::string etag(const std::string& endpoint, const Json::Value& q) const;
+
+    // Names of the underlying resources that make up this one.
+    std::vector<std::string> sources() const;
 
 private:
     const Manager& m_manager;
     const std::string m_name;
     std::vector<TimedReader*> m_readers;
 
+    mutable std::shared_ptr<const Info> m_info;
+    mutable std::mutex m_infoMutex;
+    std::atomic<uint64_t> m_writes{0};
+
     Json::Value infoSingle() const;
     Json::Value infoMulti() const;
+
+    // Answer a count query from hierarchy metadata alone, if that gives an
+    // exact result for it: see the definition for when this is possible.
+    bool countFromHierarchy(const Json::Value& q, uint64_t& points) const;
+
+    // The total number of points selected by some queries, from the
+    // hierarchy where possible and otherwise from count queries run in
+    // parallel.
+    uint64_t estimatePoints(const std::vector<Json::Value>& queries) const;
+
+    // Point counts per depth, starting at `begin`, within some bounds of a
+    // single reader.  These are memoized per reader and bounds, and extended
+    // to cover more depths as needed.
+    struct DepthCounts
+    {
+        std::size_t begin = 0;
+        std::vector<uint64_t> counts;
+    };
+
+    static constexpr std::size_t maxDepthCounts = 65536;
+
+    mutable std::map<std::string, DepthCounts> m_depthCounts;
+    mutable std::mutex m_depthCountsMutex;
 };
 
 using SharedResource = std::shared_ptr<Resource>;
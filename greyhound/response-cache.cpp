@@ -0,0 +1,125 @@
+#include <greyhound/response-cache.hpp>
+
+#include <algorithm>
+
+namespace greyhound
+{
+
+ResponseCache::ResponseCache(const std::size_t maxBytes)
+    : m_maxBytes(maxBytes)
+{ }
+
+std::string ResponseCache::key(
+        const std::string& endpoint,
+        const std::string& name,
+        const Json::Value& query)
+{
+    auto s = Json::FastWriter().write(query);
+    s.pop_back();
+    return endpoint + "/" + name + "?" + s;
+}
+
+ResponseCache::Payload ResponseCache::get(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it(m_entries.find(key));
+    if (it == m_entries.end()) return Payload();
+
+    m_order.splice(m_order.begin(), m_order, it->second.order);
+    return it->second.payload;
+}
+
+uint64_t ResponseCache::generation(
+        const std::vector<std::string>& sources) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return generationOf(sources);
+}
+
+uint64_t ResponseCache::generationOf(
+        const std::vector<std::string>& sources) const
+{
+    // Counts only increase, so any invalidation changes the sum.
+    uint64_t sum(0);
+    for (const std::string& source : sources)
+    {
+        const auto it(m_generations.find(source));
+        if (it != m_generations.end()) sum += it->second;
+    }
+    return sum;
+}
+
+void ResponseCache::insert(
+        const std::string& key,
+        Payload payload,
+        const std::vector<std::string>& sources,
+        const uint64_t generation)
+{
+    if (!payload || payload->size() > maxEntryBytes()) return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (generationOf(sources) != generation) return;
+
+    erase(key);
+
+    m_order.push_front(key);
+
+    Entry& entry(m_entries[key]);
+    entry.payload = payload;
+    entry.sources = sources;
+    entry.order = m_order.begin();
+
+    m_bytes += payload->size();
+
+    while (m_bytes > m_maxBytes && !m_order.empty())
+    {
+        const std::string last(m_order.back());
+        erase(last);
+    }
+}
+
+void ResponseCache::invalidate(const std::string& source)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    ++m_generations[source];
+
+    for (auto it(m_entries.begin()); it != m_entries.end(); )
+    {
+        const auto& sources(it->second.sources);
+        if (std::find(sources.begin(), sources.end(), source) != sources.end())
+        {
+            m_bytes -= it->second.payload->size();
+            m_order.erase(it->second.order);
+            it = m_entries.erase(it);
+        }
+        else ++it;
+    }
+}
+
+std::size_t ResponseCache::bytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytes;
+}
+
+std::size_t ResponseCache::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+void ResponseCache::erase(const std::string& key)
+{
+    auto it(m_entries.find(key));
+    if (it == m_entries.end()) return;
+
+    m_bytes -= it->second.payload->size();
+    m_order.erase(it->second.order);
+    m_entries.erase(it);
+}
+
+} // namespace greyhound
+
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <json/json.h>
+
+#include <greyhound/defs.hpp>
+
+namespace greyhound
+{
+
+// A size-bounded LRU cache of finished response payloads, keyed by endpoint,
+// resource name, and normalized query.  Each entry records the names of the
+// underlying resources from which it was produced, so that an append to any
+// of them can invalidate it.
+class ResponseCache
+{
+public:
+    using Payload = std::shared_ptr<const Data>;
+
+    ResponseCache(std::size_t maxBytes);
+
+    // Since Json::Value objects are ordered by key, the dense serialization
+    // of a parsed query is a canonical form of that query.
+    static std::string key(
+            const std::string& endpoint,
+            const std::string& name,
+            const Json::Value& query);
+
+    Payload get(const std::string& key);
+
+    // A value which changes whenever any of the given sources is
+    // invalidated.  It should be captured before producing a payload from
+    // these sources, and passed along when inserting that payload.
+    uint64_t generation(const std::vector<std::string>& sources) const;
+
+    // The insert is dropped if any of the sources have been invalidated
+    // since `generation` was captured, since the payload may predate that.
+    void insert(
+            const std::string& key,
+            Payload payload,
+            const std::vector<std::string>& sources,
+            uint64_t generation);
+
+    // Drop all entries produced from the given underlying resource.
+    void invalidate(const std::string& source);
+
+    std::size_t maxBytes() const { return m_maxBytes; }
+
+    // Payloads larger than this are never cached, so that one huge response
+    // cannot flush the entire cache.
+    std::size_t maxEntryBytes() const { return m_maxBytes / 8; }
+
+    std::size_t bytes() const;
+    std::size_t size() const;
+
+private:
+    void erase(const std::string& key);
+
+    // Requires m_mutex to be held.
+    uint64_t generationOf(const std::vector<std::string>& sources) const;
+
+    struct Entry
+    {
+        Payload payload;
+        std::vector<std::string> sources;
+        std::list<std::string>::iterator order;
+    };
+
+    const std::size_t m_maxBytes;
+    std::size_t m_bytes = 0;
+
+    // Most recently used keys are at the front.
+    std::list<std::string> m_order;
+    std::unordered_map<std::string, Entry> m_entries;
+
+    // Invalidation count for each source.
+    std::unordered_map<std::string, uint64_t> m_generations;
+
+    mutable std::mutex m_mutex;
+};
+
+} // namespace greyhound
+
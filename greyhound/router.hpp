@@ -1,9 +1,17 @@
 #pragma once
 
-#include <entwine/util/pool.hpp>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 
 #include <greyhound/defs.hpp>
+#include <greyhound/listener.hpp>
 #include <greyhound/manager.hpp>
+#include <greyhound/scheduler.hpp>
+#include <greyhound/trace.hpp>
 
 namespace greyhound
 {
@@ -17,78 +25,178 @@ class Router
     using ResPtr = std::shared_ptr<typename S::Response>;
 
 public:
+    using Lane = Scheduler::Lane;
+
+    // Each of the configured acceptors listens on the same port with its
+    // own event loop of ioThreads threads.  These only parse requests and
+    // send responses, handing the requests themselves to the worker pool.
     template<typename... Args>
     Router(Manager& manager, unsigned int port, Args&&... args)
         : m_manager(manager)
-        , m_server(std::forward<Args>(args)...)
-        , m_pool(m_manager.threads())
+        , m_scheduler(
+                m_manager.threads(),
+                std::max<std::size_t>(m_manager.threads() / 4, 1))
     {
-        m_server.config.port = port;
-        m_server.config.timeout_request = 0;
-        m_server.config.timeout_content = 0;
+        const auto& http(m_manager.config()["http"]);
+        const std::size_t acceptors(
+                std::max<std::size_t>(http["acceptors"].asUInt64(), 1));
+        const std::size_t ioThreads(
+                std::max<std::size_t>(http["ioThreads"].asUInt64(), 1));
+
+        if (acceptors > 1 && !Listener<S>::reusePortSupported())
+        {
+            throw std::runtime_error(
+                    "Multiple acceptors require SO_REUSEPORT");
+        }
 
-        m_server.default_resource["GET"] = [](ResPtr res, ReqPtr req)
+        for (std::size_t i(0); i < acceptors; ++i)
         {
-            res->write(HttpStatusCode::client_error_not_found);
-        };
+            m_servers.emplace_back(new Listener<S>(acceptors > 1, args...));
+
+            auto& config(m_servers.back()->config);
+            config.port = port;
+            config.thread_pool_size = ioThreads;
+            config.timeout_request = 0;
+            config.timeout_content = 0;
+        }
+
+        const std::string labels("port=\"" + std::to_string(port) + "\"");
+        auto& metrics(m_manager.metrics());
+
+        metrics.gauge(
+                this,
+                "greyhound_pool_queued",
+                "Requests waiting for a worker thread.",
+                labels + ",lane=\"light\"",
+                [this]() { return m_scheduler.queued(Lane::Light); });
+
+        metrics.gauge(
+                this,
+                "greyhound_pool_queued",
+                "Requests waiting for a worker thread.",
+                labels + ",lane=\"heavy\"",
+                [this]() { return m_scheduler.queued(Lane::Heavy); });
+
+        metrics.gauge(
+                this,
+                "greyhound_pool_busy",
+                "Worker threads processing a request.",
+                labels,
+                [this]() { return m_busy.load(); });
 
-        m_server.on_error = [](ReqPtr req, const SimpleWeb::error_code& ec)
+        metrics.gauge(
+                this,
+                "greyhound_pool_threads",
+                "Worker threads.",
+                labels,
+                [this]() { return m_manager.threads(); });
+
+        for (auto& server : m_servers)
         {
-            if (
-                    ec &&
-                    ec != SimpleWeb::errc::operation_canceled &&
-                    ec != SimpleWeb::errc::broken_pipe &&
-                    ec != SimpleWeb::asio::error::eof)
+            server->default_resource["GET"] = [](ResPtr res, ReqPtr req)
             {
-                std::cout << "Error " << ec << ": " << ec.message() <<
-                    std::endl;
-            }
-        };
+                res->write(HttpStatusCode::client_error_not_found);
+            };
+
+            server->on_error = &Router::onError;
+        }
+    }
+
+    std::size_t acceptors() const { return m_servers.size(); }
+    std::size_t ioThreads() const
+    {
+        return m_servers.front()->config.thread_pool_size;
+    }
+
+    // Requests in the light lane are expected to be quick, and are served
+    // ahead of heavy ones, with some workers reserved for them.
+    template<typename F>
+    void get(std::string match, F f, Lane lane = Lane::Heavy)
+    {
+        route("GET", match, f, lane);
     }
 
     template<typename F>
-    void get(std::string match, F f) { route("GET", match, f); }
+    void put(std::string match, F f, Lane lane = Lane::Heavy)
+    {
+        route("PUT", match, f, lane);
+    }
 
+    // Route a request for a resource, which will be created if needed and
+    // passed to the handler.
     template<typename F>
-    void put(std::string match, F f) { route("PUT", match, f); }
+    void route(std::string method, std::string match, F f, Lane lane)
+    {
+        raw(method, match, lane, [this, f](Req& req, Res& res)
+        {
+            const std::string name(req.path_match[1]);
+            if (auto resource = m_manager.get(name, req))
+            {
+                f(*resource, req, res);
+            }
+            else
+            {
+                throw HttpError(
+                        HttpStatusCode::client_error_not_found,
+                        name + " could not be created");
+            }
+        });
+    }
 
+    // Route a request that is not associated with any resource.
     template<typename F>
-    void route(std::string method, std::string match, F f)
+    void raw(std::string method, std::string match, Lane lane, F f)
     {
-        m_server.resource[match][method] = [this, &f](ResPtr res, ReqPtr req)
+        const auto handler([this, lane, f](ResPtr res, ReqPtr req)
         {
             // res->close_connection_after_response = true;
-            m_pool.add([this, &f, req, res]() mutable
+
+            // Fail fast rather than queueing without bound.  Each lane is
+            // limited separately, so a backlog of heavy requests does not
+            // cause light ones to be rejected.
+            const std::size_t maxQueue(m_manager.admission().maxQueue());
+            if (maxQueue && m_scheduler.queued(lane) >= maxQueue)
+            {
+                error(
+                        *res,
+                        HttpStatusCode::client_error_too_many_requests,
+                        "Server is busy");
+                return;
+            }
+
+            const TimePoint queued(getNow());
+
+            m_scheduler.add(lane, [this, f, req, res, queued]() mutable
             {
-                auto error(
-                        [this, &res](HttpStatusCode code, std::string message)
+                ++m_busy;
+
+                std::shared_ptr<Trace> trace;
+                if (m_manager.tracing())
+                {
+                    const auto it(req->header.find("traceparent"));
+                    trace = std::make_shared<Trace>(
+                            queued,
+                            it != req->header.end() ? it->second : "");
+                    trace->add("queue", queued, getNow());
+                }
+                Trace::Bind bind(trace);
+
+                // A response that failed after its body began streaming was
+                // aborted by its Chunker, which marks its connection to be
+                // closed.  Writing an error into the middle of its body would
+                // corrupt the connection, so it is only counted.
+                auto error([this, &res](HttpStatusCode code, std::string m)
                 {
-                    // Don't cache errors.  This is a multi-map, so remove any
-                    // existing Cache-Control setting.
-                    Headers h(m_manager.headers());
-                    for (auto it(h.begin()); it != h.end(); )
+                    if (res->close_connection_after_response)
                     {
-                        if (it->first == "Cache-Control") it = h.erase(it);
-                        else ++it;
+                        m_manager.metrics().error(code);
                     }
-
-                    h.emplace("Cache-Control", "public, max-age=0");
-                    res->write(code, message, h);
+                    else this->error(*res, code, m);
                 });
 
                 try
                 {
-                    const std::string name(req->path_match[1]);
-                    if (auto resource = m_manager.get(name, *req))
-                    {
-                        f(*resource, *req, *res);
-                    }
-                    else
-                    {
-                        throw HttpError(
-                                HttpStatusCode::client_error_not_found,
-                                name + " could not be created");
-                    }
+                    f(*req, *res);
                 }
                 catch (HttpError& e)
                 {
@@ -112,19 +220,77 @@ public:
                 req.reset();
                 if (res) std::cout << "Nonzero res" << std::endl;
                 if (req) std::cout << "Nonzero req" << std::endl;
+
+                --m_busy;
             });
-        };
+        });
+
+        for (auto& server : m_servers)
+        {
+            server->resource[match][method] = handler;
+        }
+    }
+
+    ~Router() { m_manager.metrics().unregister(this); }
+
+    // Blocks until stopped.
+    void start()
+    {
+        if (m_servers.size() == 1) return m_servers.front()->start();
+
+        std::vector<std::thread> threads;
+        for (auto& server : m_servers)
+        {
+            Listener<S>* s(server.get());
+            threads.emplace_back([s]() { s->start(); });
+        }
+        for (auto& t : threads) t.join();
+    }
+
+    void stop()
+    {
+        for (auto& server : m_servers) server->stop();
+        m_scheduler.join();
     }
 
-    void start() { m_server.start(); }
-    void stop() { m_server.stop(); m_pool.join(); }
-    unsigned int port() const { return m_server.config.port; }
+    unsigned int port() const { return m_servers.front()->config.port; }
 
 private:
+    static void onError(ReqPtr req, const SimpleWeb::error_code& ec)
+    {
+        if (
+                ec &&
+                ec != SimpleWeb::errc::operation_canceled &&
+                ec != SimpleWeb::errc::broken_pipe &&
+                ec != SimpleWeb::asio::error::eof)
+        {
+            std::cout << "Error " << ec << ": " << ec.message() << std::endl;
+        }
+    }
+
+    void error(Res& res, HttpStatusCode code, const std::string& message)
+    {
+        m_manager.metrics().error(code);
+
+        // Don't cache errors.  This is a multi-map, so remove any existing
+        // Cache-Control setting.
+        Headers h(m_manager.headers());
+        for (auto it(h.begin()); it != h.end(); )
+        {
+            if (it->first == "Cache-Control") it = h.erase(it);
+            else ++it;
+        }
+
+        h.emplace("Cache-Control", "public, max-age=0");
+        res.write(code, message, h);
+    }
+
     Manager& m_manager;
-    S m_server;
+    std::vector<std::unique_ptr<Listener<S>>> m_servers;
+
+    std::atomic<std::size_t> m_busy{0};
 
-    entwine::Pool m_pool;
+    Scheduler m_scheduler;
 };
 
 } // namespace greyhound
@@ -0,0 +1,97 @@
+#include <greyhound/scheduler.hpp>
+
+#include <iostream>
+
+namespace greyhound
+{
+
+Scheduler::Scheduler(const std::size_t threads, const std::size_t reserved)
+{
+    for (std::size_t i(0); i < threads; ++i)
+    {
+        const bool lightOnly(i < reserved);
+        m_threads.emplace_back([this, lightOnly]() { work(lightOnly); });
+    }
+}
+
+Scheduler::~Scheduler()
+{
+    join();
+}
+
+void Scheduler::add(const Lane lane, Task task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        queue(lane).push_back(std::move(task));
+    }
+
+    if (lane == Lane::Light) m_lightCv.notify_one();
+    m_cv.notify_one();
+}
+
+void Scheduler::join()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stop) return;
+        m_stop = true;
+    }
+
+    m_cv.notify_all();
+    m_lightCv.notify_all();
+    for (auto& t : m_threads) t.join();
+}
+
+std::size_t Scheduler::queued(const Lane lane) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_queues[static_cast<std::size_t>(lane)].size();
+}
+
+void Scheduler::work(const bool lightOnly)
+{
+    auto& light(queue(Lane::Light));
+    auto& heavy(queue(Lane::Heavy));
+    auto& cv(lightOnly ? m_lightCv : m_cv);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true)
+    {
+        cv.wait(lock, [&]()
+        {
+            return m_stop || !light.empty() || (!lightOnly && !heavy.empty());
+        });
+
+        auto& q(!light.empty() || lightOnly ? light : heavy);
+        if (q.empty())
+        {
+            // Stopping, and nothing is left for us to do.
+            if (m_stop) return;
+            continue;
+        }
+
+        Task task(std::move(q.front()));
+        q.pop_front();
+        lock.unlock();
+
+        try
+        {
+            task();
+        }
+        catch (std::exception& e)
+        {
+            std::cout << "Scheduler task failed: " << e.what() << std::endl;
+        }
+        catch (...)
+        {
+            std::cout << "Scheduler task failed: unknown error" << std::endl;
+        }
+
+        lock.lock();
+    }
+}
+
+} // namespace greyhound
+
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace greyhound
+{
+
+// A worker pool with two priority lanes, so that cheap requests are never
+// stuck behind expensive ones.  Some workers are reserved for the light
+// lane, and the rest serve both lanes, always preferring light tasks.  Adding
+// a task never blocks, so any bound on queue depth must be enforced by the
+// caller.
+class Scheduler
+{
+public:
+    enum class Lane { Light, Heavy };
+    using Task = std::function<void()>;
+
+    Scheduler(std::size_t threads, std::size_t reserved);
+    ~Scheduler();
+
+    void add(Lane lane, Task task);
+
+    // Finish all queued tasks and stop the workers.
+    void join();
+
+    std::size_t queued(Lane lane) const;
+
+private:
+    void work(bool lightOnly);
+
+    std::deque<Task>& queue(Lane lane)
+    {
+        return m_queues[static_cast<std::size_t>(lane)];
+    }
+
+    std::array<std::deque<Task>, 2> m_queues;
+    std::vector<std::thread> m_threads;
+    bool m_stop = false;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::condition_variable m_lightCv;
+};
+
+} // namespace greyhound
+
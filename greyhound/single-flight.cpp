@@ -0,0 +1,61 @@
+#include <greyhound/single-flight.hpp>
+
+namespace greyhound
+{
+
+SingleFlight::Ticket::Ticket(SingleFlight& flights, std::string key)
+    : m_flights(flights)
+    , m_key(key)
+{
+    std::lock_guard<std::mutex> lock(m_flights.m_mutex);
+
+    auto& flight(m_flights.m_flights[m_key]);
+    if (!flight)
+    {
+        flight = std::make_shared<Flight>();
+        m_leader = true;
+    }
+
+    m_flight = flight;
+}
+
+SingleFlight::Ticket::~Ticket()
+{
+    if (m_leader && !m_complete) complete(Payload());
+}
+
+SingleFlight::Payload SingleFlight::Ticket::wait()
+{
+    std::unique_lock<std::mutex> lock(m_flight->mutex);
+    m_flight->cv.wait(lock, [this]() { return m_flight->done; });
+    return m_flight->payload;
+}
+
+void SingleFlight::Ticket::complete(Payload payload)
+{
+    m_complete = true;
+
+    // Remove the flight before waking its followers, so that later arrivals
+    // start a new one - or more likely, find the result in the cache.
+    {
+        std::lock_guard<std::mutex> lock(m_flights.m_mutex);
+        m_flights.m_flights.erase(m_key);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_flight->mutex);
+        m_flight->payload = payload;
+        m_flight->done = true;
+    }
+
+    m_flight->cv.notify_all();
+}
+
+std::size_t SingleFlight::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_flights.size();
+}
+
+} // namespace greyhound
+
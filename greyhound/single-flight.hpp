@@ -0,0 +1,69 @@
+#pragma once
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <greyhound/response-cache.hpp>
+
+namespace greyhound
+{
+
+// Coalesces concurrent executions of identical queries.  The first caller
+// for a key becomes the leader and runs the query, and callers arriving while
+// it is in flight wait for the leader's finished payload instead of running
+// the query themselves.
+class SingleFlight
+{
+    struct Flight;
+
+public:
+    using Payload = ResponseCache::Payload;
+
+    class Ticket
+    {
+    public:
+        Ticket(SingleFlight& flights, std::string key);
+        ~Ticket();
+
+        Ticket(const Ticket&) = delete;
+        Ticket& operator=(const Ticket&) = delete;
+
+        bool leader() const { return m_leader; }
+
+        // Followers only: block until the leader finishes.  Returns null if
+        // the leader failed or did not produce a complete payload, in which
+        // case the follower should run the query itself.
+        Payload wait();
+
+        // Leader only: publish the payload to all followers.  If a leader
+        // is destroyed without completing, its followers receive null.
+        void complete(Payload payload);
+
+    private:
+        SingleFlight& m_flights;
+        const std::string m_key;
+        std::shared_ptr<Flight> m_flight;
+        bool m_leader = false;
+        bool m_complete = false;
+    };
+
+    std::size_t size() const;
+
+private:
+    struct Flight
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool done = false;
+        Payload payload;
+    };
+
+    std::map<std::string, std::shared_ptr<Flight>> m_flights;
+    mutable std::mutex m_mutex;
+};
+
+} // namespace greyhound
+
@@ -0,0 +1,144 @@
+#include <greyhound/static-files.hpp>
+
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+#include <entwine/third/arbiter/arbiter.hpp>
+
+namespace greyhound
+{
+
+namespace
+{
+
+std::string extension(const std::string& path)
+{
+    const std::size_t dot(path.rfind('.'));
+    return dot == std::string::npos ? "" : path.substr(dot + 1);
+}
+
+std::string contentType(const std::string& path)
+{
+    static const std::map<std::string, std::string> types {
+        { "css",    "text/css; charset=utf-8" },
+        { "html",   "text/html; charset=utf-8" },
+        { "js",     "application/javascript; charset=utf-8" },
+        { "json",   "application/json" },
+        { "png",    "image/png" },
+        { "svg",    "image/svg+xml" }
+    };
+
+    const auto it(types.find(extension(path)));
+    return it != types.end() ? it->second : "application/octet-stream";
+}
+
+// Images are already compressed.
+bool compressible(const std::string& type)
+{
+    return type.compare(0, 5, "text/") == 0 ||
+        type.find("javascript") != std::string::npos ||
+        type.find("json") != std::string::npos ||
+        type.find("svg") != std::string::npos;
+}
+
+Data load(const std::string& path)
+{
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file.good()) throw std::runtime_error("Could not read " + path);
+
+    return Data(
+            (std::istreambuf_iterator<char>(file)),
+            std::istreambuf_iterator<char>());
+}
+
+std::string hex(const uint64_t h)
+{
+    std::ostringstream ss;
+    ss << std::hex << std::setw(16) << std::setfill('0') << h;
+    return ss.str();
+}
+
+// Point each reference to a sibling asset, written as "static/<name>", at
+// its current version.
+void versionReferences(
+        Data& html,
+        const std::map<std::string, std::string>& versions)
+{
+    std::string s(html.begin(), html.end());
+    for (const auto& p : versions)
+    {
+        const std::string from("\"static/" + p.first + "\"");
+        const std::string to("\"static/" + p.first + "?v=" + p.second + "\"");
+
+        std::size_t pos(0);
+        while ((pos = s.find(from, pos)) != std::string::npos)
+        {
+            s.replace(pos, from.size(), to);
+            pos += to.size();
+        }
+    }
+    html.assign(s.begin(), s.end());
+}
+
+} // unnamed namespace
+
+StaticFiles::StaticFiles(
+        const std::string& root,
+        const std::vector<encoding::Coding>& codings)
+{
+    std::map<std::string, Data> contents;
+    for (const std::string& path :
+            entwine::arbiter::fs::glob(entwine::arbiter::util::join(root, "*")))
+    {
+        contents[entwine::arbiter::util::getBasename(path)] = load(path);
+    }
+
+    // Assets must be versioned before the HTML files that refer to them.
+    std::map<std::string, std::string> versions;
+    for (const auto& p : contents)
+    {
+        if (extension(p.first) == "html") continue;
+        versions[p.first] =
+            hex(encoding::hash(p.second.data(), p.second.size()));
+    }
+
+    for (auto& p : contents)
+    {
+        const std::string& name(p.first);
+        Data& data(p.second);
+
+        if (extension(name) == "html") versionReferences(data, versions);
+
+        File& file(m_files[name]);
+        file.type = contentType(name);
+        file.version = hex(encoding::hash(data.data(), data.size()));
+        file.etag = '"' + file.version + '"';
+
+        if (compressible(file.type))
+        {
+            for (const encoding::Coding coding : codings)
+            {
+                Data coded(encoding::encode(data, coding));
+                if (coded.size() >= data.size()) continue;
+
+                m_bytes += coded.size();
+                file.variants[coding] = std::move(coded);
+            }
+        }
+
+        m_bytes += data.size();
+        file.variants[encoding::Coding::Identity] = std::move(data);
+    }
+}
+
+const StaticFiles::File* StaticFiles::find(const std::string& path) const
+{
+    const auto it(m_files.find(path));
+    return it != m_files.end() ? &it->second : nullptr;
+}
+
+} // namespace greyhound
+
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <greyhound/defs.hpp>
+#include <greyhound/encoding.hpp>
+
+namespace greyhound
+{
+
+// The files of the bundled web viewer, loaded into memory once at startup
+// along with a compressed copy of each text file in every configured coding.
+// Serving one is then a map lookup and a single write.
+//
+// Each file has a strong ETag derived from its contents.  References from
+// HTML files to their sibling assets are rewritten to carry that ETag as a
+// version parameter, so requests for a current version may be cached by
+// clients forever, while the HTML itself is revalidated.
+class StaticFiles
+{
+public:
+    struct File
+    {
+        std::string type;
+        std::string etag;
+        std::string version;
+
+        // Keyed by coding, excluding any that would not be smaller than
+        // the original.  The identity entry is always present.
+        std::map<encoding::Coding, Data> variants;
+    };
+
+    StaticFiles(
+            const std::string& root,
+            const std::vector<encoding::Coding>& codings);
+
+    // Null for paths that were not loaded, including any attempt to reach
+    // outside of the root.
+    const File* find(const std::string& path) const;
+
+    std::size_t size() const { return m_files.size(); }
+    std::size_t bytes() const { return m_bytes; }
+
+    // Write the file at `path` in the given coding, or an identity copy if
+    // that coding was not worth keeping.  If `version` matches the current
+    // version of the file, the response may be cached indefinitely.
+    template<typename Req, typename Res>
+    void serve(
+            Req& req,
+            Res& res,
+            const std::string& path,
+            const std::string& version,
+            encoding::Coding coding,
+            Headers h) const;
+
+private:
+    std::map<std::string, File> m_files;
+    std::size_t m_bytes = 0;
+};
+
+template<typename Req, typename Res>
+void StaticFiles::serve(
+        Req& req,
+        Res& res,
+        const std::string& path,
+        const std::string& version,
+        encoding::Coding coding,
+        Headers h) const
+{
+    const File* file(find(path));
+    if (!file)
+    {
+        res.write(HttpStatusCode::client_error_not_found);
+        return;
+    }
+
+    auto it(file->variants.find(coding));
+    if (it == file->variants.end())
+    {
+        coding = encoding::Coding::Identity;
+        it = file->variants.find(coding);
+    }
+
+    const std::string etag(
+            coding == encoding::Coding::Identity ?
+                file->etag :
+                file->etag.substr(0, file->etag.size() - 1) + "-" +
+                    encoding::name(coding) + '"');
+
+    if (version.size() && version == file->version)
+    {
+        h.erase("Cache-Control");
+        h.emplace("Cache-Control", "public, max-age=31536000, immutable");
+    }
+
+    h.emplace("ETag", etag);
+    h.emplace("Vary", "Accept-Encoding");
+
+    const auto match(req.header.find("If-None-Match"));
+    if (match != req.header.end() && encoding::matches(match->second, etag))
+    {
+        res.write(HttpStatusCode::redirection_not_modified, h);
+        return;
+    }
+
+    const Data& data(it->second);
+    h.emplace("Content-Type", file->type);
+    h.emplace("Content-Length", std::to_string(data.size()));
+    if (coding != encoding::Coding::Identity)
+    {
+        h.emplace("Content-Encoding", encoding::name(coding));
+    }
+
+    res.write(h);
+    res.write(data.data(), data.size());
+}
+
+} // namespace greyhound
+
@@ -0,0 +1,164 @@
+#include <greyhound/trace.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <sstream>
+
+namespace greyhound
+{
+
+namespace
+{
+
+thread_local std::shared_ptr<Trace> bound;
+
+std::string randomHex(const std::size_t digits)
+{
+    thread_local std::mt19937_64 gen(std::random_device{}());
+
+    std::string s;
+    char buf[17];
+    while (s.size() < digits)
+    {
+        std::snprintf(
+                buf,
+                sizeof(buf),
+                "%016llx",
+                static_cast<unsigned long long>(gen()));
+        s += buf;
+    }
+    return s.substr(0, digits);
+}
+
+bool isHex(const std::string& s)
+{
+    return s.find_first_not_of("0123456789abcdef") == std::string::npos &&
+        s.find_first_not_of('0') != std::string::npos;
+}
+
+} // unnamed namespace
+
+Trace::Trace(const TimePoint start, const std::string& traceparent)
+    : m_start(start)
+    , m_epochMicros(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count() -
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                getNow() - start).count())
+{
+    // Version 00 is "00-<trace id>-<parent id>-<flags>".
+    if (traceparent.size() == 55 && traceparent.compare(0, 3, "00-") == 0)
+    {
+        const std::string traceId(traceparent.substr(3, 32));
+        const std::string parentId(traceparent.substr(36, 16));
+        if (isHex(traceId) && isHex(parentId))
+        {
+            m_traceId = traceId;
+            m_parentId = parentId;
+        }
+    }
+
+    if (m_traceId.empty()) m_traceId = randomHex(32);
+}
+
+Trace::Scope::Scope(const char* name)
+    : m_trace(current())
+    , m_name(name)
+    , m_start(m_trace ? getNow() : TimePoint())
+{ }
+
+Trace::Scope::~Scope()
+{
+    if (m_trace) m_trace->add(m_name, m_start, getNow());
+}
+
+Trace::Bind::Bind(std::shared_ptr<Trace> trace)
+    : m_previous(std::move(bound))
+{
+    bound = std::move(trace);
+}
+
+Trace::Bind::~Bind()
+{
+    bound = std::move(m_previous);
+}
+
+Trace* Trace::current()
+{
+    return bound.get();
+}
+
+std::shared_ptr<Trace> Trace::shared()
+{
+    return bound;
+}
+
+int64_t Trace::micros(const TimePoint t) const
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            t - m_start).count();
+}
+
+void Trace::add(const std::string& name, TimePoint start, TimePoint end)
+{
+    Span span;
+    span.name = name;
+    span.start = micros(start);
+    span.duration = micros(end) - span.start;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    bool found(false);
+    for (Total& total : m_totals)
+    {
+        if (total.name == name)
+        {
+            total.duration += span.duration;
+            found = true;
+            break;
+        }
+    }
+    if (!found) m_totals.push_back(Total { name, span.duration });
+
+    if (m_spans.size() < maxSpans) m_spans.push_back(std::move(span));
+}
+
+std::string Trace::serverTiming() const
+{
+    std::ostringstream ss;
+    ss.setf(std::ios::fixed);
+    ss.precision(3);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const Total& total : m_totals)
+    {
+        ss << total.name << ";dur=" << total.duration / 1000.0 << ", ";
+    }
+    ss << "total;dur=" << micros(getNow()) / 1000.0;
+
+    return ss.str();
+}
+
+void Trace::stamp(Headers& h)
+{
+    const Trace* trace(current());
+    if (!trace) return;
+
+    auto it(h.find("Server-Timing"));
+    if (it != h.end()) it->second = trace->serverTiming();
+}
+
+std::vector<Trace::Span> Trace::spans() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_spans;
+}
+
+std::string Trace::spanId()
+{
+    return randomHex(16);
+}
+
+} // namespace greyhound
+
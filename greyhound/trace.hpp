@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <greyhound/defs.hpp>
+
+namespace greyhound
+{
+
+// Timing breakdown of a single request, as a list of named spans.  The trace
+// of the request being handled is bound to its thread, so stages deep in the
+// call stack may time themselves with a Trace::Scope without the trace being
+// passed through every signature.  Scopes cost a thread-local lookup when no
+// trace is bound.
+class Trace
+{
+public:
+    struct Span
+    {
+        std::string name;
+
+        // Microseconds, relative to the start of the trace.
+        int64_t start = 0;
+        int64_t duration = 0;
+    };
+
+    // The trace and parent span IDs are continued from a W3C traceparent
+    // header value if one is given, and are otherwise random.
+    Trace(TimePoint start, const std::string& traceparent = "");
+
+    // Times a stage of the bound trace, if any, for the lifetime of this
+    // object.  The name must outlive the scope.
+    class Scope
+    {
+    public:
+        explicit Scope(const char* name);
+        ~Scope();
+
+    private:
+        Trace* m_trace;
+        const char* m_name;
+        TimePoint m_start;
+    };
+
+    // Binds a trace, which may be null, to this thread for the lifetime of
+    // this object.  Work handed to other threads may be included in the
+    // trace by binding current() there as well.
+    class Bind
+    {
+    public:
+        explicit Bind(std::shared_ptr<Trace> trace);
+        ~Bind();
+
+    private:
+        std::shared_ptr<Trace> m_previous;
+    };
+
+    static Trace* current();
+    static std::shared_ptr<Trace> shared();
+
+    void add(const std::string& name, TimePoint start, TimePoint end);
+
+    // Value for a Server-Timing header: the total duration of each stage,
+    // in milliseconds, in the order in which each first started, followed
+    // by the total so far.
+    std::string serverTiming() const;
+
+    // Replace any Server-Timing header in `h` with the current value of the
+    // bound trace.  Headers without one are left alone, so its presence is
+    // what enables the header for a response.
+    static void stamp(Headers& h);
+
+    std::vector<Span> spans() const;
+
+    // Wall clock time at which the trace started.
+    int64_t epochMicros() const { return m_epochMicros; }
+    int64_t micros(TimePoint t) const;
+
+    const std::string& traceId() const { return m_traceId; }
+    const std::string& parentId() const { return m_parentId; }
+
+    // A random span ID, as 16 hex digits.
+    static std::string spanId();
+
+private:
+    // Beyond this many spans, only the per-stage totals are kept.
+    static constexpr std::size_t maxSpans = 256;
+
+    struct Total
+    {
+        std::string name;
+        int64_t duration;
+    };
+
+    const TimePoint m_start;
+    const int64_t m_epochMicros;
+    std::string m_traceId;
+    std::string m_parentId;
+
+    mutable std::mutex m_mutex;
+    std::vector<Span> m_spans;
+    std::vector<Total> m_totals;
+};
+
+} // namespace greyhound
+
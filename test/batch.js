@@ -0,0 +1,162 @@
+var common = require('./common');
+var server = common.server;
+var resource = common.resource;
+var util = require('./util');
+
+var chai = require('chai');
+var chaiHttp = require('chai-http');
+var should = chai.should();
+var expect = chai.expect;
+chai.use(chaiHttp);
+
+var Promise = require('bluebird');
+var http = require('http');
+
+var info = util.httpSync('/info');
+
+var batch = (query) => {
+    var path = resource + '/batch' + Object.keys(query).reduce((p, c) => {
+        return p + (p.length ? '&' : '?') + c + '=' + JSON.stringify(query[c]);
+    }, '');
+
+    return new Promise((resolve, reject) => {
+        chai.request(server).get(path)
+        .buffer()
+        .parse((res, cb) => {
+            res.setEncoding('binary');
+            res.data = '';
+            res.on('data', (chunk) => res.data += chunk);
+            res.on('end', () => {
+                var b = new ArrayBuffer(res.data.length);
+                var view = new Uint8Array(b);
+                for (var i = 0; i < b.byteLength; ++i) {
+                    view[i] = res.data.charCodeAt(i);
+                }
+                cb(null, b);
+            });
+        })
+        .end((err, res) => resolve(res));
+    });
+};
+
+// Split a batch response into its length-prefixed segments.
+var segmentsFrom = (buffer) => {
+    var view = new DataView(buffer);
+    var segments = [];
+    for (var offset = 0; offset < buffer.byteLength; ) {
+        var size = view.getUint32(offset, true);
+        offset += 4;
+        segments.push(buffer.slice(offset, offset + size));
+        offset += size;
+    }
+    return segments;
+};
+
+describe('batch', () => {
+    it('returns one segment per node, matching /read', (done) => {
+        var schema = util.xyz;
+        var nodes = util.split(info.bounds).map((b) => {
+            return { bounds: b, depthBegin: 8, depthEnd: 9 };
+        });
+
+        batch({ schema: schema, nodes: nodes })
+        .then((res) => {
+            res.should.have.status(200);
+
+            var segments = segmentsFrom(res.body);
+            expect(segments.length).to.equal(nodes.length);
+
+            return Promise.all(nodes.map((node, i) => {
+                return util.read({
+                    schema: schema,
+                    bounds: node.bounds,
+                    depthBegin: node.depthBegin,
+                    depthEnd: node.depthEnd
+                })
+                .then((res) => {
+                    expect(util.numPointsFrom(segments[i], schema)).to.equal(
+                        util.numPointsFrom(res.body, schema));
+                });
+            }));
+        })
+        .then(() => done());
+    });
+
+    it('honors per-node schema and compression', (done) => {
+        var bounds = util.split(info.bounds);
+        var xyzi = util.xyz.concat([
+            { name: 'Intensity', type: 'unsigned', size: 2 }
+        ]);
+        var nodes = [
+            { bounds: bounds[0], depth: 8, compress: true },
+            { bounds: bounds[1], depth: 8, schema: xyzi }
+        ];
+
+        batch({ schema: util.xyz, nodes: nodes })
+        .then((res) => {
+            res.should.have.status(200);
+
+            var segments = segmentsFrom(res.body);
+            expect(segments.length).to.equal(nodes.length);
+
+            // Read afterward, so these may be served from entries cached by
+            // the batch - which must match what /read would produce.
+            return Promise.all(nodes.map((node, i) => {
+                var query = {
+                    schema: node.schema || util.xyz,
+                    bounds: node.bounds,
+                    depth: node.depth
+                };
+                if (node.compress) query.compress = true;
+
+                return util.read(query)
+                .then((res) => {
+                    var a = new Uint8Array(segments[i]);
+                    var b = new Uint8Array(res.body);
+                    expect(a.length).to.equal(b.length);
+                    expect(a.findIndex((v, j) => v !== b[j])).to.equal(-1);
+                });
+            }));
+        })
+        .then(() => done());
+    });
+
+    it('truncates a response that fails after it began streaming', (done) => {
+        // The first node is large enough to be streamed before the second,
+        // which has invalid bounds, fails.
+        var nodes = [{ }, { bounds: 'invalid' }];
+        var path = resource + '/batch?schema=' +
+            encodeURIComponent(JSON.stringify(util.xyz)) +
+            '&nodes=' + encodeURIComponent(JSON.stringify(nodes));
+
+        var finished = false;
+        var finish = (body, complete) => {
+            if (finished) return;
+            finished = true;
+
+            expect(complete).to.equal(false);
+            expect(body.indexOf('HTTP/1.1')).to.equal(-1);
+            done();
+        };
+
+        http.get(server + path, (res) => {
+            res.statusCode.should.equal(200);
+            res.setEncoding('binary');
+
+            var body = '';
+            res.on('data', (chunk) => body += chunk);
+            res.on('aborted', () => finish(body, false));
+            res.on('error', () => finish(body, false));
+            res.on('end', () => finish(body, res.complete));
+        });
+    });
+
+    it('rejects requests without nodes', (done) => {
+        batch({ schema: util.xyz })
+        .then((res) => {
+            res.should.have.status(400);
+            done();
+        });
+    });
+});
+
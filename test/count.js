@@ -0,0 +1,51 @@
+var common = require('./common');
+var server = common.server;
+var resource = common.resource;
+var util = require('./util');
+
+var chai = require('chai');
+var chaiHttp = require('chai-http');
+var should = chai.should();
+var expect = chai.expect;
+chai.use(chaiHttp);
+
+var Promise = require('bluebird');
+
+var info = util.httpSync('/info');
+
+var count = (query) => {
+    var path = resource + '/count' + Object.keys(query).reduce((p, c) => {
+        return p + (p.length ? '&' : '?') + c + '=' + JSON.stringify(query[c]);
+    }, '');
+
+    return new Promise((resolve, reject) => {
+        chai.request(server).get(path).end((err, res) => resolve(res));
+    });
+};
+
+describe('count', () => {
+    it('answers aligned queries from the hierarchy exactly', (done) => {
+        var bounds = util.split(info.bounds)[0];
+        var query = { bounds: bounds, depthBegin: 6, depthEnd: 9 };
+
+        // An empty filter selects every point, but can't be answered from
+        // the hierarchy, so this runs a real count of the same points.
+        var counted = Object.assign({ filter: { } }, query);
+
+        Promise.all([count(query), count(counted)])
+        .then((results) => {
+            results[0].should.have.status(200);
+            results[1].should.have.status(200);
+
+            var fast = results[0].body;
+            var slow = results[1].body;
+
+            expect(slow.points).to.be.above(0);
+            expect(fast.points).to.equal(slow.points);
+
+            expect(slow.chunks).to.be.above(0);
+            should.not.exist(fast.chunks);
+            done();
+        });
+    });
+});
@@ -0,0 +1,101 @@
+var chai = require('chai');
+var expect = chai.expect;
+
+var Promise = require('bluebird');
+var childProcess = require('child_process');
+var fs = require('fs');
+var http = require('http');
+var os = require('os');
+var path = require('path');
+
+// These tests run servers of their own, since the disk cache only applies to
+// remote storage and must be seen to survive a restart.
+var bin = process.env.GREYHOUND_BIN ||
+    path.join(__dirname, '../build/greyhound/greyhound');
+var data = path.join(__dirname, '../data');
+var port = 8091;
+
+// Serve the test data over HTTP, so that it is remote to greyhound.
+var serveData = () => new Promise((resolve) => {
+    var server = http.createServer((req, res) => {
+        var file = path.join(data, decodeURIComponent(req.url.split('?')[0]));
+        fs.stat(file, (err, stat) => {
+            if (err || !stat.isFile() || file.indexOf(data) !== 0) {
+                res.writeHead(404);
+                return res.end();
+            }
+
+            res.writeHead(200, { 'Content-Length': stat.size });
+            if (req.method === 'HEAD') return res.end();
+            fs.createReadStream(file).pipe(res);
+        });
+    });
+    server.listen(0, () => resolve(server));
+});
+
+var get = (p) => new Promise((resolve, reject) => {
+    http.get('http://localhost:' + port + p, (res) => {
+        var body = '';
+        res.setEncoding('binary');
+        res.on('data', (chunk) => body += chunk);
+        res.on('end', () => resolve({ status: res.statusCode, body: body }));
+    }).on('error', reject);
+});
+
+var start = (config) => {
+    var proc = childProcess.spawn(bin, ['-c', config]);
+    var ready = () => get('/ready').then((res) => {
+        if (res.status !== 200) throw new Error('Not ready');
+        return proc;
+    })
+    .catch(() => Promise.delay(250).then(ready));
+    return ready();
+};
+
+var stop = (proc) => new Promise((resolve) => {
+    proc.on('exit', () => resolve());
+    proc.kill('SIGINT');
+});
+
+var hits = () => get('/metrics').then((res) => {
+    var line = res.body.split('\n').find((l) => {
+        return l.indexOf('greyhound_disk_cache_hits_total ') === 0;
+    });
+    return line ? parseFloat(line.split(' ').pop()) : 0;
+});
+
+describe('disk cache', function() {
+    var dataServer;
+    var config;
+
+    before(function() {
+        if (!fs.existsSync(bin) || !fs.existsSync(data)) this.skip();
+
+        var dir = fs.mkdtempSync(path.join(os.tmpdir(), 'greyhound-'));
+        return serveData().then((server) => {
+            dataServer = server;
+            config = path.join(dir, 'config.json');
+            fs.writeFileSync(config, JSON.stringify({
+                paths: ['http://localhost:' + server.address().port],
+                tmp: dir,
+                diskCacheSize: '256MB',
+                diskCachePath: path.join(dir, 'cache'),
+                http: { port: port }
+            }));
+        });
+    });
+
+    after(() => { if (dataServer) dataServer.close(); });
+
+    it('serves chunks from disk after a restart', () => {
+        var read = '/resource/ellipsoid/read?depthEnd=10';
+        return start(config)
+        .then((proc) => get(read).then(() => stop(proc)))
+        .then(() => start(config))
+        .then((proc) => {
+            return get(read).then(hits).then((n) => {
+                return stop(proc).then(() => expect(n).to.be.above(0));
+            });
+        });
+    });
+});
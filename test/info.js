@@ -73,5 +73,27 @@ describe('info', () => {
             done();
         });
     });
-});
 
+    it('compresses for clients accepting gzip', (done) => {
+        chai.request(server).get(resource + '/info')
+        .set('Accept-Encoding', 'gzip')
+        .end((err, res) => {
+            res.should.have.status(200);
+            res.should.have.header('content-encoding', 'gzip');
+            res.should.have.header('vary', /Accept-Encoding/);
+            res.body.numPoints.should.equal(100000);
+            done();
+        });
+    });
+
+    it('is uncompressed by default', (done) => {
+        chai.request(server).get(resource + '/info')
+        .set('Accept-Encoding', 'identity')
+        .end((err, res) => {
+            res.should.have.status(200);
+            res.should.not.have.header('content-encoding');
+            res.body.numPoints.should.equal(100000);
+            done();
+        });
+    });
+});
@@ -0,0 +1,71 @@
+var common = require('./common');
+var server = common.server;
+var resource = common.resource;
+
+var chai = require('chai');
+var chaiHttp = require('chai-http');
+var should = chai.should();
+var expect = chai.expect;
+chai.use(chaiHttp);
+
+var scrape = () => new Promise((resolve, reject) => {
+    chai.request(server).get('/metrics')
+    .buffer()
+    .parse((res, cb) => {
+        res.setEncoding('utf8');
+        res.text = '';
+        res.on('data', (chunk) => res.text += chunk);
+        res.on('end', () => cb(null, res.text));
+    })
+    .end((err, res) => resolve(res));
+});
+
+var sample = (text, name, labels) => {
+    var line = text.split('\n').find((l) => l.startsWith(name + labels + ' '));
+    return line ? parseFloat(line.split(' ').pop()) : undefined;
+};
+
+describe('metrics', () => {
+    it('exposes Prometheus-formatted metrics', (done) => {
+        scrape().then((res) => {
+            res.should.have.status(200);
+            res.header['content-type'].should.match(/^text\/plain/);
+            res.text.should.contain('# TYPE greyhound_requests_total counter');
+            res.text.should.contain(
+                '# TYPE greyhound_request_duration_seconds histogram');
+            res.text.should.contain('greyhound_pool_threads');
+            res.text.should.contain('greyhound_cache_max_bytes');
+            done();
+        });
+    });
+
+    it('writes byte gauges as exact integers', (done) => {
+        scrape().then((res) => {
+            res.text.should.match(/^greyhound_cache_max_bytes [0-9]+$/m);
+            done();
+        });
+    });
+
+    it('counts requests per endpoint and resource', (done) => {
+        var name = resource.split('/').pop();
+        var labels = '{endpoint="info",resource="' + name + '"}';
+
+        var before;
+        scrape()
+        .then((res) => {
+            before = sample(res.text, 'greyhound_requests_total', labels) || 0;
+            return new Promise((resolve) => {
+                chai.request(server).get(resource + '/info')
+                .end((err, res) => resolve(res));
+            });
+        })
+        .then(() => new Promise((resolve) => setTimeout(resolve, 10)))
+        .then(() => scrape())
+        .then((res) => {
+            var after = sample(res.text, 'greyhound_requests_total', labels);
+            expect(after).to.equal(before + 1);
+            done();
+        });
+    });
+});
+
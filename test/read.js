@@ -229,5 +229,114 @@ describe('read', () => {
             done();
         });
     });
-});
 
+    it('reorders and widens dimensions as entwine does', (done) => {
+        var narrow = [
+            { name: 'Intensity', type: 'unsigned', size: 2 },
+            { name: 'X', type: 'floating', size: 8 }
+        ];
+        var wide = [
+            { name: 'X', type: 'floating', size: 8 },
+            { name: 'Intensity', type: 'unsigned', size: 4 }
+        ];
+
+        // Spatial dimensions must keep their native types to be read
+        // natively, so entwine converts this schema itself.
+        var reference = [
+            { name: 'Intensity', type: 'unsigned', size: 4 },
+            { name: 'X', type: 'floating', size: 4 }
+        ];
+
+        Promise.all([
+            util.read({ depth: 6, schema: narrow }),
+            util.read({ depth: 6, schema: wide }),
+            util.read({ depth: 6, schema: reference })
+        ])
+        .then((results) => {
+            var n = util.numPointsFrom(results[2].body, reference);
+            expect(n).to.be.above(0);
+            expect(util.numPointsFrom(results[0].body, narrow)).to.equal(n);
+            expect(util.numPointsFrom(results[1].body, wide)).to.equal(n);
+
+            var a = new DataView(results[0].body);
+            var b = new DataView(results[1].body);
+            var r = new DataView(results[2].body);
+
+            for (var i = 0; i < n; ++i)
+            {
+                var x = r.getFloat32(i * 8 + 4, true);
+                var intensity = r.getUint32(i * 8, true);
+
+                expect(Math.fround(a.getFloat64(i * 10 + 2, true)))
+                    .to.equal(x);
+                expect(a.getUint16(i * 10, true)).to.equal(intensity);
+
+                expect(Math.fround(b.getFloat64(i * 12, true))).to.equal(x);
+                expect(b.getUint32(i * 12 + 8, true)).to.equal(intensity);
+            }
+
+            done();
+        });
+    });
+
+    it('reports a timing breakdown', (done) => {
+        util.read({ depth: 4, schema: util.xyz })
+        .then((res) => {
+            res.should.have.status(200);
+            should.exist(res.header['server-timing']);
+            res.header['server-timing'].should.match(/total;dur=[0-9.]+$/);
+            done();
+        });
+    });
+
+    it('answers conditional requests with 304', (done) => {
+        var query = { depth: 4, schema: util.xyz };
+        util.read(query)
+        .then((res) => {
+            res.should.have.status(200);
+            should.exist(res.header['etag']);
+            return util.read(query, { 'If-None-Match': res.header['etag'] });
+        })
+        .then((res) => {
+            res.should.have.status(304);
+            done();
+        });
+    });
+
+    it('serves byte ranges of complete responses', (done) => {
+        var query = { depth: 4, schema: util.xyz };
+        var full;
+        util.read(query)
+        .then((res) => {
+            full = new Uint8Array(res.body);
+            return util.read(query, { 'Range': 'bytes=2-9' });
+        })
+        .then((res) => {
+            res.should.have.status(206);
+            res.header['content-range'].should.equal(
+                'bytes 2-9/' + full.length);
+            expect(Array.from(new Uint8Array(res.body)))
+                .to.deep.equal(Array.from(full.slice(2, 10)));
+            done();
+        });
+    });
+
+    it('serves byte ranges of responses that were not cached', (done) => {
+        // The redundant option makes this query distinct from earlier ones,
+        // so that its first response is not served from the cache.
+        var query = { depth: 3, schema: util.xyz, compress: false };
+        var part;
+        util.read(query, { 'Range': 'bytes=2-9' })
+        .then((res) => {
+            res.should.have.status(206);
+            part = new Uint8Array(res.body);
+            return util.read(query);
+        })
+        .then((res) => {
+            var full = new Uint8Array(res.body);
+            expect(Array.from(part))
+                .to.deep.equal(Array.from(full.slice(2, 10)));
+            done();
+        });
+    });
+});
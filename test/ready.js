@@ -0,0 +1,19 @@
+var common = require('./common');
+var server = common.server;
+
+var chai = require('chai');
+var chaiHttp = require('chai-http');
+var should = chai.should();
+chai.use(chaiHttp);
+
+describe('ready', () => {
+    it('reports readiness once prewarming is complete', (done) => {
+        chai.request(server).get('/ready')
+        .end((err, res) => {
+            res.should.have.status(200);
+            res.header['cache-control'].should.equal('no-cache');
+            done();
+        });
+    });
+});
+
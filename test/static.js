@@ -0,0 +1,60 @@
+var common = require('./common');
+var server = common.server;
+var resource = common.resource;
+
+var chai = require('chai');
+var chaiHttp = require('chai-http');
+var should = chai.should();
+chai.use(chaiHttp);
+
+describe('static', () => {
+    var page;
+
+    it('serves a versioned page', (done) => {
+        chai.request(server).get(resource + '/static')
+        .end((err, res) => {
+            res.should.have.status(200);
+            res.should.have.header('etag');
+            res.should.have.header('content-type', /text\/html/);
+            res.text.should.match(/static\/render\.js\?v=[0-9a-f]{16}/);
+            page = res;
+            done();
+        });
+    });
+
+    it('revalidates the page', (done) => {
+        chai.request(server).get(resource + '/static')
+        .set('If-None-Match', page.header['etag'])
+        .end((err, res) => {
+            res.should.have.status(304);
+            done();
+        });
+    });
+
+    it('revalidates the page against a list of weak tags', (done) => {
+        chai.request(server).get(resource + '/static')
+        .set('If-None-Match', '"stale", W/' + page.header['etag'])
+        .end((err, res) => {
+            res.should.have.status(304);
+            done();
+        });
+    });
+
+    it('serves versioned assets as immutable', (done) => {
+        var path = page.text.match(/static\/render\.js\?v=[0-9a-f]{16}/)[0];
+        chai.request(server).get(resource + '/' + path)
+        .end((err, res) => {
+            res.should.have.status(200);
+            res.should.have.header('cache-control', /immutable/);
+            done();
+        });
+    });
+
+    it('404s files outside of the viewer', (done) => {
+        chai.request(server).get(resource + '/static/..%2Fapp.cpp')
+        .end((err, res) => {
+            res.should.have.status(404);
+            done();
+        });
+    });
+});
@@ -72,14 +72,16 @@ var xyz = [
     { name: 'Z', type: 'floating', size: 4 }
 ];
 
-var read = (query) => {
+var read = (query, headers) => {
     if (!query) query = { };
+    if (!headers) headers = { };
     var path = resource + '/read' + Object.keys(query).reduce((p, c) => {
         return p + (p.length ? '&' : '?') + c + '=' + JSON.stringify(query[c]);
     }, '');
 
     return new Promise((resolve, reject) => {
         chai.request(server).get(path)
+        .set(headers)
         .buffer()
         .parse(parseBinary)
         .end((err, res) => resolve(res));